@@ -0,0 +1,224 @@
+#include "asset_loader.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <chrono>
+#include "file_funcs.h"
+#include "stb_image.h"
+
+asset_loader::asset_loader(int num_threads) : num_threads(num_threads), next_job(0), handed_out(0) {
+	if (this->num_threads <= 0) {
+		this->num_threads = (int)std::thread::hardware_concurrency();
+		if (this->num_threads <= 0) {
+			this->num_threads = 1;
+		}
+	}
+}
+
+asset_loader::~asset_loader() {
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	for (size_t i = 0; i < jobs.size(); i++) {
+		release((int)i);
+	}
+}
+
+static int add_job(std::vector<asset_job>& jobs, int type, const char* path) {
+	asset_job j;
+	j.type = type;
+	j.path = path;
+	j.ok = false;
+	j.ms = 0.0;
+	j.pixels = NULL;
+	j.width = 0;
+	j.height = 0;
+	jobs.push_back(j);
+	return (int)jobs.size() - 1;
+}
+
+int asset_loader::add_mesh(const char* path) {
+	return add_job(jobs, ASSET_MESH, path);
+}
+
+int asset_loader::add_texture(const char* path) {
+	return add_job(jobs, ASSET_TEXTURE, path);
+}
+
+// decode an image to RGBA from a mapping of the whole file. NULL on failure
+static unsigned char* decode_image(const char* path, int& width, int& height) {
+	mapped_file mf;
+	if (!map_file(path, mf)) {
+		return NULL;
+	}
+	unsigned char* pixels = NULL;
+	int n;
+	if (mf.size <= INT_MAX) {
+		pixels = stbi_load_from_memory((const stbi_uc*)mf.data, (int)mf.size, &width, &height, &n, 4);
+	}
+	unmap_file(mf);
+	return pixels;
+}
+
+// the CPU half of a job. nothing in here may touch GL
+static void run_job(asset_job& j) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (ASSET_MESH == j.type) {
+		j.ok = map_mesh(j.path.c_str(), j.mesh);
+	} else {
+		j.pixels = decode_image(j.path.c_str(), j.width, j.height);
+		j.ok = NULL != j.pixels;
+	}
+	j.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void worker_main(asset_loader* loader) {
+	for (;;) {
+		int job;
+		{
+			std::lock_guard<std::mutex> guard(loader->lock);
+			if (loader->next_job >= (int)loader->jobs.size()) {
+				return;
+			}
+			job = loader->next_job++;
+		}
+		run_job(loader->jobs[job]);
+		{
+			std::lock_guard<std::mutex> guard(loader->lock);
+			loader->done.push_back(job);
+		}
+		loader->done_signal.notify_one();
+	}
+}
+
+void asset_loader::start() {
+	// no more threads than jobs
+	int count = num_threads < (int)jobs.size() ? num_threads : (int)jobs.size();
+	for (int i = 0; i < count; i++) {
+		workers.push_back(std::thread(worker_main, this));
+	}
+}
+
+// call with the lock held and done not empty
+static int take_done(asset_loader* loader) {
+	int job = loader->done.front();
+	loader->done.erase(loader->done.begin());
+	loader->handed_out++;
+	return job;
+}
+
+bool asset_loader::wait_next(int& job) {
+	if (finished()) {
+		return false;
+	}
+	std::unique_lock<std::mutex> guard(lock);
+	done_signal.wait(guard, [this] { return !done.empty(); });
+	job = take_done(this);
+	return true;
+}
+
+bool asset_loader::poll_next(int& job) {
+	if (finished()) {
+		return false;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	if (done.empty()) {
+		return false;
+	}
+	job = take_done(this);
+	return true;
+}
+
+bool asset_loader::finished() const {
+	// only the GL thread touches handed_out, so no lock needed
+	return handed_out >= (int)jobs.size();
+}
+
+void asset_loader::release(int job) {
+	asset_job& j = jobs[job];
+	unmap_mesh(j.mesh);
+	if (j.pixels) {
+		stbi_image_free(j.pixels);
+		j.pixels = NULL;
+	}
+}
+
+/*-------------------------------------BENCHMARK--------------------------------------*/
+
+static bool is_image(const std::string& path) {
+	size_t dot = path.rfind('.');
+	if (std::string::npos == dot) {
+		return false;
+	}
+	std::string ext = path.substr(dot + 1);
+	for (size_t i = 0; i < ext.size(); i++) {
+		ext[i] = (char)tolower((unsigned char)ext[i]);
+	}
+	return "jpg" == ext || "jpeg" == ext || "png" == ext;
+}
+
+void texture_decode_benchmark(const char* directory) {
+	std::vector<std::string> all, images;
+	if (!list_files(directory, all)) {
+		fprintf(stderr, "WARNING. can't read %s for the texture benchmark\n", directory);
+		return;
+	}
+	for (size_t i = 0; i < all.size(); i++) {
+		if (is_image(all[i])) {
+			images.push_back(all[i]);
+		}
+	}
+	if (images.empty()) {
+		fprintf(stderr, "WARNING. no jpg or png files in %s for the texture benchmark\n", directory);
+		return;
+	}
+
+	// the way it used to be done, one image after another on the GL thread
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double pixels = 0.0;
+	int failed = 0;
+	for (size_t i = 0; i < images.size(); i++) {
+		int w, h, n;
+		unsigned char* p = stbi_load(images[i].c_str(), &w, &h, &n, 4);
+		if (p) {
+			pixels += (double)w * h;
+			stbi_image_free(p);
+		} else {
+			failed++;
+		}
+	}
+	double serial = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("  texture decode, %i images in %s, %.1f megapixels%s\n", (int)images.size(), directory, pixels / 1e6,
+		failed ? " (some failed to decode)" : "");
+	printf("    stbi_load on one thread:  %8.1f ms  %7.1f images/s\n", serial, 1000.0 * images.size() / serial);
+
+	int cores = (int)std::thread::hardware_concurrency();
+	cores = cores > 0 ? cores : 1;
+	double one_thread = 0.0;
+	for (int threads = 1;; threads = (threads * 2 < cores) ? threads * 2 : cores) {
+		start = std::chrono::steady_clock::now();
+		{
+			asset_loader loader(threads);
+			for (size_t i = 0; i < images.size(); i++) {
+				loader.add_texture(images[i].c_str());
+			}
+			loader.start();
+			// the pixels are handed back in the order they finish, as the GL
+			// thread would get them to upload
+			int job;
+			while (loader.wait_next(job)) {
+				loader.release(job);
+			}
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (1 == threads) {
+			one_thread = ms;
+		}
+		printf("    asset_loader, %2i thread%s: %8.1f ms  %7.1f images/s  %.2fx one thread, %.2fx stbi_load\n",
+			threads, 1 == threads ? " " : "s", ms, 1000.0 * images.size() / ms, one_thread / ms, serial / ms);
+		if (threads >= cores) {
+			break;
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef _ASSET_LOADER_H_
+#define _ASSET_LOADER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "mesh_funcs.h"
+
+#define ASSET_MESH 0
+#define ASSET_TEXTURE 1
+
+/* one file to load, and what came out of it. the worker fills in the CPU side
+(mesh mapping or decoded pixels), the GL thread uploads it */
+struct asset_job {
+	int type; // ASSET_MESH or ASSET_TEXTURE
+	std::string path;
+	bool ok;
+	double ms; // time spent on the worker
+	mesh_mapping mesh;
+	unsigned char* pixels; // RGBA, from stbi_load_from_memory
+	int width;
+	int height;
+};
+
+/* loads meshes and textures on worker threads. images are decoded straight
+out of a mapping of the file, so each is read in one go rather than through
+stdio, and the workers make a decode pool for any number of them. queue
+everything with add_*, start(), then call wait_next() from the GL thread until
+it returns false, uploading each job as it arrives. uploads overlap with the
+decoding of whatever is still in flight. to keep rendering while loading, call
+poll_next() once a frame instead, until finished() */
+struct asset_loader {
+	//! num_threads 0 = one per core
+	explicit asset_loader(int num_threads = 0);
+	~asset_loader();
+	//! these return the job's index in jobs
+	int add_mesh(const char* path);
+	int add_texture(const char* path);
+	void start();
+	//! block until another job is done and give its index, false once every job has been handed out
+	bool wait_next(int& job);
+	//! the same without blocking: false if nothing has finished since the last call
+	bool poll_next(int& job);
+	//! true once every job has been handed out
+	bool finished() const;
+	//! free a job's CPU side once it has been uploaded
+	void release(int job);
+
+	std::vector<asset_job> jobs;
+	int num_threads;
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable done_signal;
+	int next_job; // next to be picked up by a worker
+	std::vector<int> done; // finished, not yet handed out
+	int handed_out;
+};
+
+// benchmark: decode every jpg and png in a directory with stbi_load on this
+// thread, then through asset_loader on 1, 2, 4... threads up to one per core,
+// and print the times and how each scales
+void texture_decode_benchmark(const char* directory);
+#endif
@@ -0,0 +1,132 @@
+#include "camera.h"
+#include <stdio.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <chrono>
+
+camera::camera() : pos(0.0f, 0.0f, 0.0f), yaw(0.0f), pitch(0.0f),
+	fovy(45.0f), aspect(1.0f), near_dist(0.1f), far_dist(1000.0f),
+	view_mat(identity_mat4()), proj_mat(identity_mat4()), view_proj_mat(identity_mat4()),
+	view_dirty(true), proj_dirty(true), view_proj_dirty(true) {}
+
+void camera::set_view(const vec3& position, float yaw_rad, float pitch_rad) {
+	if (position.v[0] == pos.v[0] && position.v[1] == pos.v[1] && position.v[2] == pos.v[2] &&
+		yaw_rad == yaw && pitch_rad == pitch) {
+		return;
+	}
+	pos = position;
+	yaw = yaw_rad;
+	pitch = pitch_rad;
+	view_dirty = true;
+	view_proj_dirty = true;
+}
+
+void camera::set_perspective(float fovy_deg, float aspect_ratio, float z_near, float z_far) {
+	if (fovy_deg == fovy && aspect_ratio == aspect && z_near == near_dist && z_far == far_dist) {
+		return;
+	}
+	fovy = fovy_deg;
+	aspect = aspect_ratio;
+	near_dist = z_near;
+	far_dist = z_far;
+	proj_dirty = true;
+	view_proj_dirty = true;
+}
+
+const mat4& camera::view() {
+	if (view_dirty) {
+		// rotate_x(yaw) * rotate_y(pitch) written out, with the position dropped
+		// into the translation. this is the matrix display() used to get from
+		// glm::eulerAngleXY(yaw, pitch)
+		float cx = cos(yaw);
+		float sx = sin(yaw);
+		float cy = cos(pitch);
+		float sy = sin(pitch);
+		view_mat = mat4(
+			cy, 0.0f, sy, pos.v[0],
+			sx * sy, cx, -sx * cy, pos.v[1],
+			-cx * sy, sx, cx * cy, pos.v[2],
+			0.0f, 0.0f, 0.0f, 1.0f
+		);
+		view_dirty = false;
+	}
+	return view_mat;
+}
+
+const mat4& camera::proj() {
+	if (proj_dirty) {
+		proj_mat = perspective(fovy, aspect, near_dist, far_dist);
+		proj_dirty = false;
+	}
+	return proj_mat;
+}
+
+const mat4& camera::view_proj() {
+	if (view_proj_dirty) {
+		view_proj_mat = proj() * view();
+		view_proj_dirty = false;
+	}
+	return view_proj_mat;
+}
+
+vec3 camera::eye() {
+	// the view is a rotation and translation, so its inverse is cheap
+	affine inv = inverse_rigid(affine(view()));
+	return vec3(inv.m[3], inv.m[7], inv.m[11]);
+}
+
+// what display() did every frame before the camera: a look_at view that was
+// thrown away, then glm::eulerAngleXY (written out here in the same column
+// order) with the position patched in, and proj * view for the culling
+static mat4 old_frame_matrices(const mat4& proj, const vec3& position, const vec3& front, const vec3& up,
+	float yaw_rad, float pitch_rad, mat4& view_out) {
+	look_at(position, position + front, up);
+	float cx = cos(yaw_rad);
+	float sx = sin(yaw_rad);
+	float cy = cos(pitch_rad);
+	float sy = sin(pitch_rad);
+	float columns[16] = {
+		cy, -sx * -sy, cx * -sy, 0.0f,
+		0.0f, cx, sx, 0.0f,
+		sy, -sx * cy, cx * cy, 0.0f,
+		position.v[0], position.v[1], position.v[2], 1.0f
+	};
+	memcpy(view_out.m, columns, sizeof(columns));
+	return proj * view_out;
+}
+
+void camera_benchmark(int frames) {
+	const vec3 front(0.0f, 0.0f, -1.0f);
+	const vec3 up(0.0f, 1.0f, 0.0f);
+	printf("camera benchmark\n");
+	// the camera sitting still, then turning a little every frame
+	for (int moving = 0; moving < 2; moving++) {
+		camera cam;
+		cam.set_perspective(45.0f, 800.0f / 600.0f, 0.1f, 1000.0f);
+		mat4 proj = perspective(45.0f, 800.0f / 600.0f, 0.1f, 1000.0f);
+		vec3 position(0.0f, 0.0f, -10.0f);
+		mat4 old_view, old_view_proj;
+		// written every frame so no frame's work can be skipped
+		volatile float sink = 0.0f;
+		std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++) {
+			float yaw_rad = moving ? i * 0.001f : 0.5f;
+			old_view_proj = old_frame_matrices(proj, position, front, up, yaw_rad, 0.25f, old_view);
+			sink = old_view_proj.m[0];
+		}
+		double before = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count();
+		t = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++) {
+			float yaw_rad = moving ? i * 0.001f : 0.5f;
+			cam.set_view(position, yaw_rad, 0.25f);
+			sink = cam.view_proj().m[0];
+		}
+		double after = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count();
+		(void)sink;
+		bool same = 0 == memcmp(old_view.m, cam.view().m, sizeof(old_view.m)) &&
+			0 == memcmp(old_view_proj.m, cam.view_proj().m, sizeof(old_view_proj.m));
+		printf("  camera %s, %i frames: before %.1f ns/frame, after %.1f ns/frame%s\n",
+			moving ? "moving" : "still", frames, before / frames, after / frames, same ? "" : ", MATRICES DIFFER");
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef _CAMERA_H_
+#define _CAMERA_H_
+
+#include "maths_funcs.h"
+
+/* the scene camera. holds the position, angles and lens, and caches the view,
+projection and view-projection matrices built from them. the setters only mark
+a matrix as stale when a value actually changes, and the getters rebuild stale
+matrices on first use, so a frame where the camera hasn't moved costs three
+compares. the view is the rotation about y by pitch, then about x by yaw, with
+the position as the translation column. the angles are in radians */
+struct camera {
+	camera();
+	//! position and angles, eg. straight from the keyboard controls every frame
+	void set_view(const vec3& position, float yaw_rad, float pitch_rad);
+	//! same arguments as perspective(). z_near/z_far because windows.h eats near and far
+	void set_perspective(float fovy_deg, float aspect_ratio, float z_near, float z_far);
+	const mat4& view();
+	const mat4& proj();
+	//! proj * view
+	const mat4& view_proj();
+	//! where the eye is in world space. not the same as pos, which is the
+	//! view's translation and so gets turned by the rotation
+	vec3 eye();
+
+	vec3 pos;
+	float yaw;
+	float pitch;
+	float fovy;
+	float aspect;
+	float near_dist;
+	float far_dist;
+
+	mat4 view_mat;
+	mat4 proj_mat;
+	mat4 view_proj_mat;
+	bool view_dirty;
+	bool proj_dirty;
+	bool view_proj_dirty;
+};
+
+// benchmark: the per-frame matrix work display() did before the camera,
+// against the camera, with it still and then moving every frame
+void camera_benchmark(int frames);
+#endif
@@ -0,0 +1,205 @@
+#include "file_funcs.h"
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*-----------------------------------MAPPED FILES-------------------------------------*/
+
+mapped_file::mapped_file() : data(NULL), size(0), file_handle(NULL), map_handle(NULL) {}
+
+bool map_file(const char* path, mapped_file& mf) {
+	mf = mapped_file();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (INVALID_HANDLE_VALUE == file) {
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || 0 == file_size.QuadPart) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (NULL == mapping) {
+		CloseHandle(file);
+		return false;
+	}
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (NULL == view) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	mf.data = view;
+	mf.size = (size_t)file_size.QuadPart;
+	mf.file_handle = file;
+	mf.map_handle = mapping;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || 0 == st.st_size) {
+		close(fd);
+		return false;
+	}
+	void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	close(fd);
+	if (MAP_FAILED == view) {
+		return false;
+	}
+	mf.data = view;
+	mf.size = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+void unmap_file(mapped_file& mf) {
+	if (NULL == mf.data) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(mf.data);
+	CloseHandle((HANDLE)mf.map_handle);
+	CloseHandle((HANDLE)mf.file_handle);
+#else
+	munmap((void*)mf.data, mf.size);
+#endif
+	mf = mapped_file();
+}
+
+/*------------------------------------FILE HELPERS------------------------------------*/
+
+bool file_stamp(const char* path, long long& mtime, long long& size) {
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path, &st) != 0) {
+		return false;
+	}
+#else
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		return false;
+	}
+#endif
+	mtime = (long long)st.st_mtime;
+	size = (long long)st.st_size;
+	return true;
+}
+
+FILE* open_file(const char* path, const char* mode) {
+#ifdef _MSC_VER
+	FILE* fp = NULL;
+	if (fopen_s(&fp, path, mode) != 0) {
+		return NULL;
+	}
+	return fp;
+#else
+	return fopen(path, mode);
+#endif
+}
+
+bool seek_file(FILE* fp, long long offset) {
+#ifdef _WIN32
+	return 0 == _fseeki64(fp, offset, SEEK_SET);
+#else
+	return 0 == fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+long long tell_file(FILE* fp) {
+#ifdef _WIN32
+	return _ftelli64(fp);
+#else
+	return (long long)ftello(fp);
+#endif
+}
+
+bool replace_file(const char* tmp_path, const char* path) {
+	// windows' rename won't replace an existing file
+	remove(path);
+	if (rename(tmp_path, path) != 0) {
+		remove(tmp_path);
+		return false;
+	}
+	return true;
+}
+
+bool write_file_atomic(const char* path, const void* data, size_t size) {
+	std::string tmp_path = std::string(path) + ".tmp";
+	FILE* fp = open_file(tmp_path.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, fp) == size;
+	ok = (0 == fclose(fp)) && ok;
+	if (!ok) {
+		remove(tmp_path.c_str());
+		return false;
+	}
+	return replace_file(tmp_path.c_str(), path);
+}
+
+bool list_files(const char* directory, std::vector<std::string>& out) {
+	out.clear();
+	std::string dir = directory;
+	if (!dir.empty() && '/' != dir[dir.size() - 1] && '\\' != dir[dir.size() - 1]) {
+		dir += '/';
+	}
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE find = FindFirstFileA((dir + "*").c_str(), &fd);
+	if (INVALID_HANDLE_VALUE == find) {
+		return false;
+	}
+	do {
+		if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			out.push_back(dir + fd.cFileName);
+		}
+	} while (FindNextFileA(find, &fd));
+	FindClose(find);
+#else
+	DIR* d = opendir(directory);
+	if (!d) {
+		return false;
+	}
+	while (struct dirent* e = readdir(d)) {
+		std::string path = dir + e->d_name;
+		struct stat st;
+		if (0 == stat(path.c_str(), &st) && S_ISREG(st.st_mode)) {
+			out.push_back(path);
+		}
+	}
+	closedir(d);
+#endif
+	std::sort(out.begin(), out.end());
+	return true;
+}
+
+unsigned int checksum32(const void* data, size_t size) {
+	const unsigned char* p = (const unsigned char*)data;
+	unsigned int h = 2166136261u;
+	size_t words = size / 4;
+	for (size_t i = 0; i < words; i++) {
+		unsigned int w;
+		memcpy(&w, p + i * 4, 4);
+		h = (h ^ w) * 16777619u;
+	}
+	for (size_t i = words * 4; i < size; i++) {
+		h = (h ^ p[i]) * 16777619u;
+	}
+	return h;
+}
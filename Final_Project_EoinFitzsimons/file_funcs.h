@@ -0,0 +1,48 @@
+#ifndef _FILE_FUNCS_H_
+#define _FILE_FUNCS_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* a read-only memory mapping of a whole file. data is NULL if the file
+couldn't be opened or is empty */
+struct mapped_file {
+	mapped_file();
+	const void* data;
+	size_t size;
+	void* file_handle; // windows only
+	void* map_handle; // windows only
+};
+
+// map a file for reading. false (and mf left empty) on failure
+bool map_file(const char* path, mapped_file& mf);
+void unmap_file(mapped_file& mf);
+
+// last modification time (seconds since the epoch) and size of a file. false
+// if it doesn't exist
+bool file_stamp(const char* path, long long& mtime, long long& size);
+
+// fopen, but through fopen_s on MSVC so it doesn't warn
+FILE* open_file(const char* path, const char* mode);
+
+// fseek/ftell with 64-bit offsets, for files over 2 GB
+bool seek_file(FILE* fp, long long offset);
+long long tell_file(FILE* fp);
+
+// move a finished temporary file over path, replacing whatever was there
+bool replace_file(const char* tmp_path, const char* path);
+
+// write a whole buffer to path by way of a temporary file, so a crash part
+// way through never leaves a half written file behind
+bool write_file_atomic(const char* path, const void* data, size_t size);
+
+// the paths of the files (not directories) in a directory, sorted. false if
+// it can't be read
+bool list_files(const char* directory, std::vector<std::string>& out);
+
+// 32-bit FNV-1a over a buffer, taken a word at a time (any tail bytes one at a
+// time). for spotting corruption, not for security
+unsigned int checksum32(const void* data, size_t size);
+#endif
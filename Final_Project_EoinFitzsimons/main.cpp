@@ -4,28 +4,24 @@
 #include <iostream>
 #include <string>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <vector> // STL dynamic memory.
+#include <algorithm>
+#include <chrono>
 
 // OpenGL includes
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
-// Assimp includes
-#include <assimp/cimport.h> // scene importer
-#include <assimp/scene.h> // collects data
-#include <assimp/postprocess.h> // various extra operations
-
 #define STB_IMAGE_IMPLEMENTATION
 // Project includes
 #include "maths_funcs.h"
+#include "mesh_funcs.h"
+#include "mesh_chunks.h"
+#include "camera.h"
+#include "asset_loader.h"
 #include "stb_image.h"
-
-// GLM includes
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm.hpp>
-#include <gtc/type_ptr.hpp>
-#include <gtx/euler_angles.hpp> 
  
 /*----------------------------------------------------------------------------
 MESH TO LOAD
@@ -34,35 +30,37 @@ MESH TO LOAD
 // put the mesh in your project directory, or provide a filepath for it here
 #define MESH_NAME "../Lab5/windmill.dae"
 #define MESH_NAME2 "../Lab5/arms.dae"
+// time pulling a synthetic mesh this big out of assimp's arrays at start up.
+// 0 to skip it
+#define EXTRACTION_BENCHMARK_VERTICES 0
+// time the maths kernels over this many steps at start up. 0 to skip it
+#define MATHS_BENCHMARK_ITERATIONS 0
+// check the batch maths against the plain versions over this many inputs at
+// start up. 0 to skip it
+#define MATHS_CHECK_COUNT 0
+// time decoding every jpg and png in this directory at start up, on one thread
+// and then on more. "" to skip it
+#define TEXTURE_BENCHMARK_DIR ""
+// how much processing assimp does on import (see mesh_funcs.h). the command
+// line can override it with -import fast or -import quality
+#define IMPORT_PROFILE IMPORT_FAST
 
 
 /*----------------------------------------------------------------------------
 ----------------------------------------------------------------------------*/
 
-#pragma region SimpleTypes
-typedef struct
-{
-	size_t mPointCount = 0;
-	std::vector<vec3> mVertices;
-	std::vector<vec3> mNormals;
-	std::vector<vec2> mTextureCoords;
-} ModelData;
-#pragma endregion SimpleTypes
-
 using namespace std;
 GLuint shaderProgramID, shaderProgramID2;
 
-ModelData mesh_data[2];
 unsigned int mesh_vao = 0;
 int width = 800;
 int height = 600;
 
-GLuint loc1, loc2, loc3;
+GLuint loc1, loc2, loc3, loc4;
 GLfloat rotate_y = 0.0f;
 GLuint tex[2], tex1; // for texture loader
 
-mat4 Gview;
-mat4 Gpersp;
+camera cam;
 mat4 Gmodel;
 
 vec3 cameraPos = vec3(0.0f, 0.0f, -10.0f);
@@ -77,89 +75,37 @@ float lastX = 800.0f / 2.0;
 float lastY = 600.0 / 2.0;
 
 
-#pragma region MESH LOADING
-/*----------------------------------------------------------------------------
-MESH LOADING FUNCTION
-----------------------------------------------------------------------------*/
-
-ModelData load_mesh(const char* file_name) {
-	ModelData modelData;
-
-	/* Use assimp to read the model file, forcing it to be read as    */
-	/* triangles. The second flag (aiProcess_PreTransformVertices) is */
-	/* relevant if there are multiple meshes in the model file that   */
-	/* are offset from the origin. This is pre-transform them so      */
-	/* they're in the right position.                                 */
-	const aiScene* scene = aiImportFile(
-		file_name,
-		aiProcess_Triangulate | aiProcess_PreTransformVertices
-	);
-
-	if (!scene) {
-		fprintf(stderr, "ERROR: reading mesh %s\n", file_name);
-		return modelData;
-	}
-
-	printf("  %i materials\n", scene->mNumMaterials);
-	printf("  %i meshes\n", scene->mNumMeshes);
-	printf("  %i textures\n", scene->mNumTextures);
-
-	for (unsigned int m_i = 0; m_i < scene->mNumMeshes; m_i++) {
-		const aiMesh* mesh = scene->mMeshes[m_i];
-		printf("    %i vertices in mesh\n", mesh->mNumVertices);
-		modelData.mPointCount += mesh->mNumVertices;
-		for (unsigned int v_i = 0; v_i < mesh->mNumVertices; v_i++) {
-			if (mesh->HasPositions()) {
-				const aiVector3D* vp = &(mesh->mVertices[v_i]);
-				modelData.mVertices.push_back(vec3(vp->x, vp->y, vp->z));
-			}
-			if (mesh->HasNormals()) {
-				const aiVector3D* vn = &(mesh->mNormals[v_i]);
-				modelData.mNormals.push_back(vec3(vn->x, vn->y, vn->z));
-			}
-			if (mesh->HasTextureCoords(0)) {
-				const aiVector3D* vt = &(mesh->mTextureCoords[0][v_i]);
-				modelData.mTextureCoords.push_back(vec2(vt->x, vt->y));
-			} 
-			if (mesh->HasTangentsAndBitangents()) {
-				/* You can extract tangents and bitangents here              */
-				/* Note that you might need to make Assimp generate this     */
-				/* data for you. Take a look at the flags that aiImportFile  */
-				/* can take.                                                 */
-			}
-		}
-	} 
-
-	aiReleaseImport(scene);
-	return modelData;
-}
-
-#pragma endregion MESH LOADING
-
 #pragma region TEXTURE LOADING
 /*----------------------------------------------------------------------------
 TEXTURE LOADING FUNCTION
 ----------------------------------------------------------------------------*/
 
-void loadTextures(GLuint texture, const char* filepath, int active_arg, const GLchar* texString, int texNum) {
-	int x, y, n;
-	int force_channels = 4;
-	unsigned char *image_data = stbi_load(filepath, &x, &y, &n, force_channels);
-	if (!image_data) {
-		fprintf(stderr, "ERROR: could not load %s\n", filepath);
-
-	}
+// the image has already been decoded to RGBA by the asset loader. this only
+// allocates the texture, the pixels go up in slices through loadTextureRows
+void beginTexture(GLuint texture, const asset_job& job) {
+	const char* filepath = job.path.c_str();
+	int x = job.width;
+	int y = job.height;
 	// NPOT check
 	if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
 		fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n",
 			filepath);
 	}
 
-	glActiveTexture(active_arg);
 	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y, 0, GL_RGBA, GL_UNSIGNED_BYTE,
-		image_data);
-	glUniform1i(glGetUniformLocation(shaderProgramID, texString), texNum);
+		NULL);
+}
+
+void loadTextureRows(GLuint texture, const asset_job& job, int first_row, int rows) {
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, job.width, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+		job.pixels + (size_t)first_row * job.width * 4);
+}
+
+// once every row is in
+void finishTexture(GLuint texture) {
+	glBindTexture(GL_TEXTURE_2D, texture);
 	glGenerateMipmap(GL_TEXTURE_2D);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -171,6 +117,15 @@ void loadTextures(GLuint texture, const char* filepath, int active_arg, const GL
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_aniso);
 
 }
+
+// flat grey, shown in place of a texture until it has streamed in
+void generatePlaceholderTexture(GLuint texture) {
+	const unsigned char grey[4] = { 160, 160, 160, 255 };
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+}
 #pragma endregion TEXTURE LOADING
 
 // Shader Functions- click on + to expand
@@ -327,53 +282,583 @@ GLuint CompileShaders2()
 // VBO Functions - click on + to expand
 #pragma region VBO_FUNCTIONS
 
+// at full detail, cull each mesh a meshlet at a time on the CPU and only draw
+// the meshlets that are on screen
+#define CULL_MESHLETS 1
+// also leave out meshlets facing away from the camera. only right when GL
+// culls back faces too, which it doesn't: everything is drawn double sided,
+// and the models' winding isn't checked. so off, or back faces would vanish
+// at full detail and come back at the other levels
+#define CULL_MESHLET_CONES 0
+// print what the meshlets cull from a ring of viewpoints as each mesh arrives
+#define MESHLET_BENCHMARK 0
+
 GLuint vao[2];
+GLuint vbo[2], ebo[2];
+GLenum index_type[2]; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, whichever fits the mesh
+int lod_count[2];
+mesh_lod_range mesh_lods[2][MAX_MESH_LODS]; // where each level of detail is in the index buffer
+std::vector<meshlet> mesh_meshlets[2]; // level 0 split up for culling on the CPU
+aabb mesh_bounds[2]; // model space, for frustum culling
+
+// how the vertex shader turns a mesh's stored vertices back into floats
+struct vertex_decode {
+	int format; // VERTEX_FLOAT or VERTEX_QUANTISED
+	vec3 position_offset;
+	vec3 position_scale;
+};
+vertex_decode mesh_decode[2];
+GLint vertex_format_location, position_offset_location, position_scale_location;
+
+// drawn in place of a mesh until it has streamed in
+GLuint placeholder_vao;
+GLsizei placeholder_count;
+GLenum placeholder_type;
+aabb placeholder_bounds;
+vertex_decode placeholder_decode;
+
+vertex_decode getVertexDecode(const mesh_mapping& mm) {
+	vertex_decode d;
+	d.format = mm.vertex_format;
+	d.position_offset = mm.position_offset;
+	d.position_scale = mm.position_scale;
+	return d;
+}
+
+// point a VAO at a vertex buffer laid out like the mesh cache (all the
+// positions, then the normals, then the uvs) and its index buffer
+void setupMeshVao(GLuint vao_id, GLuint vbo_id, GLuint ebo_id, const mesh_mapping& mm) {
+	glBindVertexArray(vao_id);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
+
+	glEnableVertexAttribArray(loc1);
+	glEnableVertexAttribArray(loc2);
+	glEnableVertexAttribArray (loc3);
+	// nothing draws with the tangents yet, so the linker is free to drop them
+	bool tangents = (GLuint)-1 != loc4;
+	if (tangents) {
+		glEnableVertexAttribArray(loc4);
+	}
+	if (VERTEX_QUANTISED == mm.vertex_format) {
+		// positions come out 0-1 across the bounds, with the tangent's sign in
+		// w. the normals and tangents go in as plain integers and the shader
+		// divides by 32767 itself, because GL 4.1 and earlier don't map snorm 0
+		// to exactly 0
+		glVertexAttribPointer(loc1, 4, GL_UNSIGNED_SHORT, GL_TRUE, 0, NULL);
+		glVertexAttribPointer(loc2, 2, GL_SHORT, GL_FALSE, 0, (const GLvoid*)mm.normal_offset);
+		glVertexAttribPointer (loc3, 2, GL_HALF_FLOAT, GL_FALSE, 0, (const GLvoid*)mm.uv_offset);
+		if (tangents) {
+			glVertexAttribPointer(loc4, 2, GL_SHORT, GL_FALSE, 0, (const GLvoid*)mm.tangent_offset);
+		}
+	}
+	else {
+		glVertexAttribPointer(loc1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glVertexAttribPointer(loc2, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)mm.normal_offset);
+		glVertexAttribPointer (loc3, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)mm.uv_offset);
+		if (tangents) {
+			glVertexAttribPointer(loc4, 4, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)mm.tangent_offset);
+		}
+	}
 
-void generateObjectBufferMesh(int index, const char* mesh) {
-	/*----------------------------------------------------------------------------
-	LOAD MESH HERE AND COPY INTO BUFFERS
-	----------------------------------------------------------------------------*/
+	// the element buffer binding is part of the VAO, so this has to come after
+	// glBindVertexArray
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_id);
+}
 
-	//Note: you may get an error "vector subscript out of range" if you are using this code for a mesh that doesnt have positions and normals
-	//Might be an idea to do a check for that before generating and binding the buffer.
+/*----------------------------------------------------------------------------
+COPY THE LOADED MESH INTO BUFFERS
+----------------------------------------------------------------------------*/
 
-	mesh_data[index] = load_mesh(mesh);
-	unsigned int vp_vbo = 0;
-	loc1 = glGetAttribLocation(shaderProgramID, "vertex_position");
-	loc2 = glGetAttribLocation(shaderProgramID, "vertex_normal");
-	loc3 = glGetAttribLocation(shaderProgramID, "vt");
+// the mesh cache is laid out exactly like the buffers, so the uploads go
+// straight from the file mapping and each byte is only touched once. the
+// buffers are filled through GL_COPY_WRITE_BUFFER so the upload never disturbs
+// whatever VAO display() left bound
+void beginObjectBufferMesh(int index, const mesh_mapping& mm) {
+	index_type[index] = (2 == mm.index_size) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	lod_count[index] = mm.lod_count;
+	for (int l = 0; l < mm.lod_count; l++) {
+		mesh_lods[index][l] = mm.lods[l];
+	}
+	mesh_meshlets[index].assign(mm.meshlets, mm.meshlets + mm.meshlet_count);
+	mesh_bounds[index] = mm.bounds;
+	mesh_decode[index] = getVertexDecode(mm);
+#if MESHLET_BENCHMARK
+	meshlet_cull_report(mm.meshlets, mm.meshlet_count, mm.bounds);
+#endif
+
+	glGenBuffers(1, &vbo[index]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vbo[index]);
+	glBufferData(GL_COPY_WRITE_BUFFER, mm.vertex_bytes, NULL, GL_STATIC_DRAW);
+	glGenBuffers(1, &ebo[index]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ebo[index]);
+	glBufferData(GL_COPY_WRITE_BUFFER, mm.index_bytes, NULL, GL_STATIC_DRAW);
+}
 
-	glGenBuffers(1, &vp_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vp_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data[index].mPointCount * sizeof(vec3), &mesh_data[index].mVertices[0], GL_STATIC_DRAW);
-	unsigned int vn_vbo = 0;
-	glGenBuffers(1, &vn_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vn_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data[index].mPointCount * sizeof(vec3), &mesh_data[index].mNormals[0], GL_STATIC_DRAW);
-
-//	This is for texture coordinates which you don't currently need, so I have commented it out
-	unsigned int vt_vbo = 0;
-	glGenBuffers (1, &vt_vbo);
-	glBindBuffer (GL_ARRAY_BUFFER, vt_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data[index].mPointCount * 2 * sizeof(float), &mesh_data[index].mTextureCoords[0], GL_STATIC_DRAW);
-	
-	glBindVertexArray(vao[index]);
+// offset and size are into the vertex bytes followed by the index bytes
+void loadObjectBufferBytes(int index, const mesh_mapping& mm, size_t offset, size_t size) {
+	if (offset < mm.vertex_bytes) {
+		size_t n = (size < mm.vertex_bytes - offset) ? size : mm.vertex_bytes - offset;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbo[index]);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, n, (const char*)mm.vertex_data + offset);
+		offset += n;
+		size -= n;
+	}
+	if (size > 0) {
+		offset -= mm.vertex_bytes;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ebo[index]);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, (const char*)mm.index_data + offset);
+	}
+}
 
-	glEnableVertexAttribArray(loc1);
-	glBindBuffer(GL_ARRAY_BUFFER, vp_vbo);
-	glVertexAttribPointer(loc1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(loc2);
-	glBindBuffer(GL_ARRAY_BUFFER, vn_vbo);
-	glVertexAttribPointer(loc2, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+void finishObjectBufferMesh(int index, const mesh_mapping& mm) {
+	setupMeshVao(vao[index], vbo[index], ebo[index], mm);
+}
 
-	//	This is for texture coordinates which you don't currently need, so I have commented it out
-	glEnableVertexAttribArray (loc3);
-	glBindBuffer (GL_ARRAY_BUFFER, vt_vbo);
-	glVertexAttribPointer (loc3, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+// the placeholder box, uploaded in one go at init
+void generatePlaceholderMesh() {
+	ModelData box;
+	make_box(box);
+	mesh_mapping mm;
+	map_model(box, mm);
+	placeholder_count = mm.index_count;
+	placeholder_type = (2 == mm.index_size) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	placeholder_bounds = mm.bounds;
+	placeholder_decode = getVertexDecode(mm);
+
+	GLuint buffers[2];
+	glGenBuffers(2, buffers);
+	glGenVertexArrays(1, &placeholder_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, mm.vertex_bytes, mm.vertex_data, GL_STATIC_DRAW);
+	setupMeshVao(placeholder_vao, buffers[0], buffers[1], mm);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mm.index_bytes, mm.index_data, GL_STATIC_DRAW);
+	unmap_mesh(mm);
 }
 
 #pragma endregion VBO_FUNCTIONS
 
+#pragma region ASSET_STREAMING
+/*----------------------------------------------------------------------------
+ASSET STREAMING
+----------------------------------------------------------------------------*/
+// with this on, display() starts straight away with grey boxes and a grey
+// texture standing in for the assets, and each one is swapped in once it has
+// loaded and finished uploading. set it to 0 to load everything in init()
+// before the first frame instead
+#define STREAM_ASSETS 1
+// the most display() uploads in one frame. anything bigger goes up over
+// several frames, so streaming never costs a frame more than this
+#define UPLOAD_BUDGET_BYTES (4 * 1024 * 1024)
+#define UPLOAD_BUDGET_MS 2.0
+// one glBufferSubData/glTexSubImage2D call, small enough that the time
+// budget gets checked often
+#define UPLOAD_SLICE_BYTES (256 * 1024)
+
+asset_loader* loader = NULL; // deleted once every asset is in
+DWORD load_start;
+int mesh_job[2], tex_job[2];
+bool mesh_ready[2], tex_ready[2]; // false = draw the placeholder
+GLuint placeholder_tex;
+
+// the job being uploaded, if any, and how many of its bytes have gone up
+int upload_job = -1;
+size_t upload_done, upload_total;
+
+void beginUpload() {
+	const asset_job& job = loader->jobs[upload_job];
+	upload_done = 0;
+	upload_total = 0;
+	if (!job.ok) {
+		// leave the placeholder up
+		fprintf(stderr, "ERROR: could not load %s\n", job.path.c_str());
+		return;
+	}
+	if (upload_job == mesh_job[0] || upload_job == mesh_job[1]) {
+		beginObjectBufferMesh(upload_job == mesh_job[0] ? 0 : 1, job.mesh);
+		upload_total = job.mesh.vertex_bytes + job.mesh.index_bytes;
+	}
+	else {
+		beginTexture(tex[upload_job == tex_job[0] ? 0 : 1], job);
+		upload_total = (size_t)job.width * job.height * 4;
+	}
+}
+
+// upload up to max_bytes more of the current job. textures go in whole rows,
+// so this returns 0 if not even one fits. returns how much went up
+size_t continueUpload(size_t max_bytes) {
+	const asset_job& job = loader->jobs[upload_job];
+	size_t n = upload_total - upload_done;
+	if (0 == n) {
+		return 0;
+	}
+	if (upload_job == mesh_job[0] || upload_job == mesh_job[1]) {
+		n = (n < max_bytes) ? n : max_bytes;
+		loadObjectBufferBytes(upload_job == mesh_job[0] ? 0 : 1, job.mesh, upload_done, n);
+	}
+	else {
+		// whole rows only. if not even one fits, the caller stops for this
+		// frame rather than go over its budget
+		size_t row_bytes = (size_t)job.width * 4;
+		int rows = (int)(max_bytes / row_bytes);
+		int rows_left = (int)(n / row_bytes);
+		if (rows < 1) {
+			return 0;
+		}
+		rows = (rows > rows_left) ? rows_left : rows;
+		loadTextureRows(tex[upload_job == tex_job[0] ? 0 : 1], job, (int)(upload_done / row_bytes), rows);
+		n = rows * row_bytes;
+	}
+	upload_done += n;
+	return n;
+}
+
+void finishUpload() {
+	const asset_job& job = loader->jobs[upload_job];
+	if (job.ok) {
+		if (upload_job == mesh_job[0] || upload_job == mesh_job[1]) {
+			int index = (upload_job == mesh_job[0]) ? 0 : 1;
+			finishObjectBufferMesh(index, job.mesh);
+			mesh_ready[index] = true;
+		}
+		else {
+			int index = (upload_job == tex_job[0]) ? 0 : 1;
+			finishTexture(tex[index]);
+			tex_ready[index] = true;
+		}
+	}
+	loader->release(upload_job);
+	upload_job = -1;
+}
+
+// upload whatever the loader has finished until this frame's budget is spent.
+// with wait set it also blocks for assets that are still loading, which is how
+// init() loads everything up front when streaming is off
+void streamAssets(size_t budget_bytes, double budget_ms, bool wait) {
+	if (!loader) {
+		return;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t spent = 0;
+	while (spent < budget_bytes) {
+		if (upload_job < 0) {
+			if (!(wait ? loader->wait_next(upload_job) : loader->poll_next(upload_job))) {
+				break;
+			}
+			beginUpload();
+		}
+		size_t slice = budget_bytes - spent;
+		size_t uploaded = continueUpload((slice < UPLOAD_SLICE_BYTES) ? slice : UPLOAD_SLICE_BYTES);
+		if (0 == uploaded && upload_done < upload_total) {
+			break;
+		}
+		spent += uploaded;
+		if (upload_done == upload_total) {
+			finishUpload();
+		}
+		if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budget_ms) {
+			break;
+		}
+	}
+	if (upload_job < 0 && loader->finished()) {
+		printf("loaded %i assets on %i threads in %i ms\n", (int)loader->jobs.size(), loader->num_threads,
+			(int)(timeGetTime() - load_start));
+		delete loader;
+		loader = NULL;
+	}
+}
+
+// the coarsest level of detail whose error covers less than this many pixels.
+// the error is the furthest any full detail vertex is from the level's
+// triangles, so this is how far the outline can move on screen
+#define LOD_ERROR_PIXELS 1.0f
+
+// the smallest and largest amounts the model matrix stretches its axes by
+void axisScales(const mat4& model, float& smallest, float& largest) {
+	smallest = largest = 0.0f;
+	for (int col = 0; col < 3; col++) {
+		float l = sqrtf(model.m[col * 4] * model.m[col * 4] + model.m[col * 4 + 1] * model.m[col * 4 + 1] +
+			model.m[col * 4 + 2] * model.m[col * 4 + 2]);
+		smallest = (0 == col || l < smallest) ? l : smallest;
+		largest = l > largest ? l : largest;
+	}
+}
+
+/* pick a level of detail by how big its error would be on screen. the error is
+scaled up by the model matrix's largest scale and projected at the nearest
+point of the mesh's bounding sphere, so it never comes out smaller than it
+really is */
+int selectLod(const mesh_lod_range* lods, int count, const mat4& model, const aabb& bounds) {
+	float smallest, model_scale;
+	axisScales(model, smallest, model_scale);
+	vec3 centre = transform_point(affine(model), (bounds.mn + bounds.mx) * 0.5f);
+	float radius = length(bounds.mx - bounds.mn) * 0.5f * model_scale;
+	float dist = length(centre - cam.eye()) - radius;
+	dist = dist > cam.near_dist ? dist : cam.near_dist;
+	// pixels per world unit at that distance
+	float pixels = (float)height / (2.0f * tanf(cam.fovy * 0.5f * ONE_DEG_IN_RAD) * dist);
+	int lod = 0;
+	while (lod + 1 < count && lods[lod + 1].error * model_scale * pixels <= LOD_ERROR_PIXELS) {
+		lod++;
+	}
+	return lod;
+}
+
+// kept between frames so culling doesn't allocate
+std::vector<unsigned char> meshlet_visible;
+std::vector<GLsizei> draw_counts;
+std::vector<const GLvoid*> draw_offsets;
+
+/* draw mesh i at full detail, leaving out the meshlets that are off screen, or
+facing away with CULL_MESHLET_CONES. a meshlet's triangles follow straight on
+from the one before it's, so runs of drawn meshlets merge into one range, and
+the ranges all go in one glMultiDrawElements. f is in model space */
+void drawMeshlets(int i, const mat4& model, const frustum& f) {
+	const std::vector<meshlet>& meshlets = mesh_meshlets[i];
+	// the cones only hold up under rotation, translation and even scaling
+	float smallest, largest;
+	axisScales(model, smallest, largest);
+	bool test_cones = CULL_MESHLET_CONES && largest - smallest <= 0.001f * largest;
+	vec3 eye = transform_point(inverse(affine(model)), cam.eye());
+	meshlet_visible.resize(meshlets.size());
+	cull_meshlets_mt(meshlets.data(), (int)meshlets.size(), f, eye, test_cones, meshlet_visible.data());
+
+	size_t index_size = (GL_UNSIGNED_SHORT == index_type[i]) ? sizeof(GLushort) : sizeof(GLuint);
+	draw_counts.clear();
+	draw_offsets.clear();
+	for (size_t m = 0; m < meshlets.size(); m++) {
+		if (!meshlet_visible[m]) {
+			continue;
+		}
+		if (m > 0 && meshlet_visible[m - 1]) {
+			draw_counts.back() += meshlets[m].index_count;
+		} else {
+			draw_counts.push_back(meshlets[m].index_count);
+			draw_offsets.push_back((const GLvoid*)((size_t)meshlets[m].first_index * index_size));
+		}
+	}
+	if (!draw_counts.empty()) {
+		glMultiDrawElements(GL_TRIANGLES, draw_counts.data(), index_type[i], draw_offsets.data(),
+			(GLsizei)draw_counts.size());
+	}
+}
+
+// draw mesh i, or the placeholder box in its place until it has streamed in.
+// the box is stretched over the mesh's bounds as soon as they are known
+void drawMesh(int i, const mat4& model, const mat4& view_proj, int matrix_location) {
+	mat4 m = model;
+	aabb bounds = mesh_bounds[i];
+	GLuint draw_vao = vao[i];
+	GLenum type = index_type[i];
+	GLsizei count = 0;
+	size_t first = 0;
+	int lod = 0;
+	if (mesh_ready[i]) {
+		lod = selectLod(mesh_lods[i], lod_count[i], model, bounds);
+		count = mesh_lods[i][lod].index_count;
+		first = mesh_lods[i][lod].first_index;
+	}
+	const vertex_decode* decode = &mesh_decode[i];
+	if (!mesh_ready[i]) {
+		affine fit = identity_affine();
+		fit = scale(fit, (bounds.mx - bounds.mn) * 0.5f);
+		fit = translate(fit, (bounds.mn + bounds.mx) * 0.5f);
+		m = model * to_mat4(fit);
+		bounds = placeholder_bounds;
+		draw_vao = placeholder_vao;
+		count = placeholder_count;
+		type = placeholder_type;
+		decode = &placeholder_decode;
+	}
+	glUniformMatrix4fv(matrix_location, 1, GL_FALSE, m.m);
+	glUniform1i(vertex_format_location, decode->format);
+	glUniform3fv(position_offset_location, 1, decode->position_offset.v);
+	glUniform3fv(position_scale_location, 1, decode->position_scale.v);
+	// skip anything off screen. the planes are pulled out in model space so the
+	// load-time bounds can be tested as they are
+	frustum f = extract_frustum(view_proj * m);
+	if (classify(f, bounds) != CULL_OUTSIDE) {
+		glBindVertexArray(draw_vao);
+		if (CULL_MESHLETS && mesh_ready[i] && 0 == lod && !mesh_meshlets[i].empty()) {
+			drawMeshlets(i, m, f);
+		} else {
+			size_t index_size = (GL_UNSIGNED_SHORT == type) ? sizeof(GLushort) : sizeof(GLuint);
+			glDrawElements(GL_TRIANGLES, count, type, (const GLvoid*)(first * index_size));
+		}
+	}
+}
+#pragma endregion ASSET_STREAMING
+
+#pragma region CHUNK_STREAMING
+/*----------------------------------------------------------------------------
+CHUNKED MESHES
+----------------------------------------------------------------------------*/
+// an obj too big to load whole, drawn from a fixed pool of GPU buffers that
+// the chunks on screen get paged into (see mesh_chunks.h). the first run
+// converts it, which takes a while for a big model. "" for none
+#define CHUNKED_MESH_NAME ""
+// how many chunks can be on the GPU at once. the pool is this many buffers the
+// size of the largest chunk, however big the model is
+#define CHUNK_POOL_SLOTS 64
+// the most a frame uploads into the pool
+#define CHUNK_UPLOAD_BUDGET_BYTES (4 * 1024 * 1024)
+
+chunked_mesh chunked;
+std::vector<aabb> chunk_bounds; // copied out of the table for classify_aabbs
+
+// a place on the GPU for one chunk
+struct chunk_slot {
+	GLuint vao, vbo, ebo;
+	int chunk; // -1 if empty
+	unsigned int last_seen; // the frame its chunk was last on screen
+	GLenum index_type;
+	GLsizei index_count;
+	vertex_decode decode;
+};
+std::vector<chunk_slot> chunk_slots;
+// each chunk's slot, -1 if it isn't on the GPU, -2 if it's damaged and never
+// will be
+std::vector<int> chunk_slot_of;
+unsigned int chunk_frame = 0;
+// kept between frames so culling doesn't allocate
+std::vector<unsigned char> chunk_visible;
+std::vector<int> visible_chunks;
+std::vector<float> chunk_distance;
+
+void initChunkedMesh() {
+	if (0 == CHUNKED_MESH_NAME[0]) {
+		return;
+	}
+	if (!map_chunked_mesh(CHUNKED_MESH_NAME, chunked)) {
+		fprintf(stderr, "ERROR: could not load %s\n", CHUNKED_MESH_NAME);
+		return;
+	}
+	chunk_bounds.resize(chunked.chunk_count);
+	for (int i = 0; i < chunked.chunk_count; i++) {
+		chunk_bounds[i] = chunked.chunks[i].bounds;
+	}
+	chunk_slot_of.assign(chunked.chunk_count, -1);
+	chunk_slots.resize(min(CHUNK_POOL_SLOTS, chunked.chunk_count));
+	for (size_t i = 0; i < chunk_slots.size(); i++) {
+		chunk_slot& s = chunk_slots[i];
+		glGenVertexArrays(1, &s.vao);
+		glGenBuffers(1, &s.vbo);
+		glGenBuffers(1, &s.ebo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, s.vbo);
+		glBufferData(GL_COPY_WRITE_BUFFER, chunked.max_vertex_bytes, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, s.ebo);
+		glBufferData(GL_COPY_WRITE_BUFFER, chunked.max_index_bytes, NULL, GL_DYNAMIC_DRAW);
+		s.chunk = -1;
+		s.last_seen = 0;
+	}
+	printf("%s: %i chunks, %lld triangles, %i slots of GPU buffers (%.1f MB)\n", CHUNKED_MESH_NAME,
+		chunked.chunk_count, chunked.triangle_count, (int)chunk_slots.size(),
+		chunk_slots.size() * (chunked.max_vertex_bytes + chunked.max_index_bytes) / (1024.0 * 1024.0));
+}
+
+// copy a chunk out of the mapping into a slot, evicting whatever was there.
+// returns the bytes uploaded, 0 if the chunk is damaged, which marks it so it
+// isn't tried again
+size_t uploadChunk(int chunk, int slot) {
+	mesh_mapping mm;
+	if (!chunk_mapping(chunked, chunk, mm)) {
+		fprintf(stderr, "ERROR: chunk %i of %s is damaged\n", chunk, CHUNKED_MESH_NAME);
+		chunk_slot_of[chunk] = -2;
+		return 0;
+	}
+	chunk_slot& s = chunk_slots[slot];
+	if (s.chunk >= 0) {
+		chunk_slot_of[s.chunk] = -1;
+	}
+	// orphan the old storage first, so a draw from it still in flight doesn't
+	// stall the upload. the size never changes, so neither does the pool's
+	glBindBuffer(GL_COPY_WRITE_BUFFER, s.vbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, chunked.max_vertex_bytes, NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, mm.vertex_bytes, mm.vertex_data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, s.ebo);
+	glBufferData(GL_COPY_WRITE_BUFFER, chunked.max_index_bytes, NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, mm.index_bytes, mm.index_data);
+	setupMeshVao(s.vao, s.vbo, s.ebo, mm);
+	s.chunk = chunk;
+	s.index_type = (2 == mm.index_size) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	s.index_count = mm.lods[0].index_count;
+	s.decode = getVertexDecode(mm);
+	chunk_slot_of[chunk] = slot;
+	return mm.vertex_bytes + mm.index_bytes;
+}
+
+/* draw the chunks on screen that are on the GPU, and page in the ones that
+aren't, nearest first, within this frame's budget. a slot goes to whichever
+chunk has been off screen longest. if more chunks are on screen than there
+are slots the furthest ones are left out, so the pool never grows */
+void drawChunkedMesh(const mat4& model, const mat4& view_proj, int matrix_location) {
+	if (chunk_slots.empty()) {
+		return;
+	}
+	chunk_frame++;
+	frustum f = extract_frustum(view_proj * model);
+	chunk_visible.resize(chunked.chunk_count);
+	classify_aabbs(f, chunk_bounds.data(), chunked.chunk_count, chunk_visible.data());
+	vec3 eye = transform_point(inverse(affine(model)), cam.eye());
+	visible_chunks.clear();
+	chunk_distance.resize(chunked.chunk_count);
+	for (int i = 0; i < chunked.chunk_count; i++) {
+		if (CULL_OUTSIDE != chunk_visible[i]) {
+			visible_chunks.push_back(i);
+			chunk_distance[i] = length2((chunk_bounds[i].mn + chunk_bounds[i].mx) * 0.5f - eye);
+		}
+	}
+	std::sort(visible_chunks.begin(), visible_chunks.end(),
+		[](int a, int b) { return chunk_distance[a] < chunk_distance[b]; });
+	if (visible_chunks.size() > chunk_slots.size()) {
+		visible_chunks.resize(chunk_slots.size());
+	}
+	for (size_t i = 0; i < visible_chunks.size(); i++) {
+		int slot = chunk_slot_of[visible_chunks[i]];
+		if (slot >= 0) {
+			chunk_slots[slot].last_seen = chunk_frame;
+		}
+	}
+	size_t spent = 0;
+	for (size_t i = 0; i < visible_chunks.size() && spent < CHUNK_UPLOAD_BUDGET_BYTES; i++) {
+		int c = visible_chunks[i];
+		if (chunk_slot_of[c] != -1) {
+			continue;
+		}
+		// there's always one left over from an earlier frame, with at most as
+		// many chunks on screen as slots
+		int slot = -1;
+		for (size_t s = 0; s < chunk_slots.size(); s++) {
+			if (chunk_slots[s].last_seen != chunk_frame &&
+				(slot < 0 || chunk_slots[s].last_seen < chunk_slots[slot].last_seen)) {
+				slot = (int)s;
+			}
+		}
+		if (slot < 0) {
+			break;
+		}
+		size_t uploaded = uploadChunk(c, slot);
+		if (uploaded > 0) {
+			spent += uploaded;
+			chunk_slots[slot].last_seen = chunk_frame;
+		}
+	}
+
+	glUniformMatrix4fv(matrix_location, 1, GL_FALSE, model.m);
+	for (size_t i = 0; i < visible_chunks.size(); i++) {
+		int slot = chunk_slot_of[visible_chunks[i]];
+		if (slot < 0) {
+			continue;
+		}
+		const chunk_slot& s = chunk_slots[slot];
+		glUniform1i(vertex_format_location, s.decode.format);
+		glUniform3fv(position_offset_location, 1, s.decode.position_offset.v);
+		glUniform3fv(position_scale_location, 1, s.decode.position_scale.v);
+		glBindVertexArray(s.vao);
+		glDrawElements(GL_TRIANGLES, s.index_count, s.index_type, NULL);
+	}
+}
+#pragma endregion CHUNK_STREAMING
+
 
 void display() {
 
@@ -384,7 +869,8 @@ void display() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glUseProgram(shaderProgramID);
 
-	glBindVertexArray(vao[0]);
+	// swap in whatever has finished loading, within this frame's budget
+	streamAssets(UPLOAD_BUDGET_BYTES, UPLOAD_BUDGET_MS, false);
 	
 	//Declare your uniform variables that will be used in your shader
 	int matrix_location = glGetUniformLocation(shaderProgramID, "model");
@@ -392,47 +878,37 @@ void display() {
 	int proj_mat_location = glGetUniformLocation(shaderProgramID, "proj");
 	int texture_num_loc = glGetUniformLocation(shaderProgramID, "texture_num");
 
-	mat4 base = Gmodel;
+	// the hierarchy is all rotations, translations and scales, so it is built
+	// with the 3x4 affine type and only widened to a mat4 for the upload
+	affine base = affine(Gmodel);
 
 	// Root of the Hierarchy
 	//mat4 view = identity_mat4();
 
-	mat4 gview = look_at(cameraPos, cameraPos + cameraFront, cameraUp);
-	glm::mat4 Gview;
-
-	Gview = glm::eulerAngleXY(yaw, pitch);
-	Gview[3][0] = cameraPos.v[0];
-	Gview[3][1] = cameraPos.v[1];
-	Gview[3][2] = cameraPos.v[2];
-
+	// the camera only rebuilds its matrices when these have changed
+	cam.set_view(cameraPos, yaw, pitch);
 
-	/*for (int i = 0; i < 4; i++) {
-	for (int j = 0; j < 4; j++)
-	Gview[i][j] = gview.m[i*4 + j];
-	}*/
-	/*gView[0][0] = cameraPos.x;
-	gView[0][1] = cameraPos.y;
-	gView[0][2] = cameraPos.z;*/
 	base = rotate_z_deg(base, 180); // GO OFF THIS TO GET IN RIGHT POSITION
 	base = rotate_y_deg(base, 180);
 	
 
 
 	// update uniforms & draw
-	glUniformMatrix4fv(proj_mat_location, 1, GL_FALSE, Gpersp.m);
-	glUniformMatrix4fv(view_mat_location, 1, GL_FALSE, glm::value_ptr(Gview));
-	glUniformMatrix4fv(matrix_location, 1, GL_FALSE, base.m);
-
-	//glActiveTexture(GL_TEXTURE0);
+	glUniformMatrix4fv(proj_mat_location, 1, GL_FALSE, cam.proj().m);
+	glUniformMatrix4fv(view_mat_location, 1, GL_FALSE, cam.view().m);
+	mat4 base_mat = to_mat4(base);
+	const mat4& view_proj = cam.view_proj();
+
+	// the shader picks basic_texture (unit 0) or metal_texture (unit 1) by
+	// texture_num, so each texture has to go on its own unit
+	glActiveTexture(GL_TEXTURE0);
 	glUniform1i(texture_num_loc, 0);
-	glBindVertexArray(vao[0]);
-	glBindTexture(GL_TEXTURE_2D, tex[0]);
+	glBindTexture(GL_TEXTURE_2D, tex_ready[0] ? tex[0] : placeholder_tex);
 	//glUniform1i(glGetUniformLocation(shaderProgramID, "basic_texture"), 0); // gltexture0 
-	glDrawArrays(GL_TRIANGLES, 0, mesh_data[0].mPointCount);
+	drawMesh(0, base_mat, view_proj, matrix_location);
 
-	glBindVertexArray(vao[1]);
 	// Set up the child matrix
-	mat4 modelChild = identity_mat4();
+	affine modelChild = identity_affine();
 	modelChild = rotate_z_deg(modelChild, 180);
 	modelChild = rotate_z_deg(modelChild, rotate_y);
 	modelChild = translate(modelChild, vec3(0.0f, 7.0f, -0.15f));
@@ -444,12 +920,13 @@ void display() {
 	// Update the appropriate uniform and draw the mesh again
 	glActiveTexture(GL_TEXTURE1);
 	glUniform1i(texture_num_loc, 1);
-	//glBindVertexArray(vao[1]);
-	glBindTexture(GL_TEXTURE_2D, tex[1]);
+	glBindTexture(GL_TEXTURE_2D, tex_ready[1] ? tex[1] : placeholder_tex);
 	//glUniform1i(glGetUniformLocation(shaderProgramID, "metal_texture"), 1);
 	//
-	glUniformMatrix4fv(matrix_location, 1, GL_FALSE, modelChild.m);
-	glDrawArrays(GL_TRIANGLES, 0, mesh_data[1].mPointCount);
+	drawMesh(1, to_mat4(modelChild), view_proj, matrix_location);
+
+	// the chunked model sits at the origin as it was scanned
+	drawChunkedMesh(identity_mat4(), view_proj, matrix_location);
 
 	glutSwapBuffers();
 }
@@ -481,15 +958,55 @@ void init()
 	//GLuint shaderProgramID2 = CompileShaders2();
 	glGenVertexArrays(2, vao);
 	glGenTextures(2, tex);
-	// load mesh into a vertex buffer array
-	generateObjectBufferMesh(0, MESH_NAME);
-	//load_texture("../lab5/brown.jpg", tex[0]);
-	loadTextures(tex[0], "../lab5/brown.jpg", GL_TEXTURE0, "basic_texture", 0);
-	loadTextures(tex[1], "../lab5/texture3.jpg", GL_TEXTURE1, "metal_texture", 1);
-	generateObjectBufferMesh(1, MESH_NAME2);
+	loc1 = glGetAttribLocation(shaderProgramID, "vertex_position");
+	loc2 = glGetAttribLocation(shaderProgramID, "vertex_normal");
+	loc3 = glGetAttribLocation(shaderProgramID, "vt");
+	loc4 = glGetAttribLocation(shaderProgramID, "vertex_tangent");
+	vertex_format_location = glGetUniformLocation(shaderProgramID, "vertex_format");
+	position_offset_location = glGetUniformLocation(shaderProgramID, "position_offset");
+	position_scale_location = glGetUniformLocation(shaderProgramID, "position_scale");
+	glUniform1i(glGetUniformLocation(shaderProgramID, "basic_texture"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgramID, "metal_texture"), 1);
+
+	// stand-ins until the real assets are in. a unit box until the loader has
+	// the mesh's bounds
+	generatePlaceholderMesh();
+	glGenTextures(1, &placeholder_tex);
+	generatePlaceholderTexture(placeholder_tex);
+	mesh_bounds[0] = mesh_bounds[1] = placeholder_bounds;
+
+#if MATHS_BENCHMARK_ITERATIONS
+	mat4_benchmark(MATHS_BENCHMARK_ITERATIONS);
+	inline_benchmark(MATHS_BENCHMARK_ITERATIONS);
+	camera_benchmark(MATHS_BENCHMARK_ITERATIONS);
+#endif
+#if MATHS_CHECK_COUNT
+	quat_batch_check(MATHS_CHECK_COUNT);
+	normalise_check(MATHS_CHECK_COUNT);
+#endif
+#if EXTRACTION_BENCHMARK_VERTICES
+	extraction_benchmark(EXTRACTION_BENCHMARK_VERTICES);
+#endif
+	if (TEXTURE_BENCHMARK_DIR[0]) {
+		texture_decode_benchmark(TEXTURE_BENCHMARK_DIR);
+	}
+
+	// meshes are mapped/imported and images decoded on worker threads, and each
+	// one is uploaded on the GL thread once it's ready (see streamAssets)
+	load_start = timeGetTime();
+	loader = new asset_loader();
+	mesh_job[0] = loader->add_mesh(MESH_NAME);
+	mesh_job[1] = loader->add_mesh(MESH_NAME2);
+	tex_job[0] = loader->add_texture("../lab5/brown.jpg");
+	tex_job[1] = loader->add_texture("../lab5/texture3.jpg");
 	//load_texture("../lab5/texture2.jpg", tex[1]);
-	Gpersp = perspective(45.0f, (float)width / (float)height, 0.1f, 1000.0f);
+	loader->start();
+#if !STREAM_ASSETS
+	streamAssets((size_t)-1, 1e30, true);
+#endif
+	cam.set_perspective(45.0f, (float)width / (float)height, 0.1f, 1000.0f);
 	Gmodel = identity_mat4();
+	initChunkedMesh();
 }
 
 GLfloat release;
@@ -582,10 +1099,29 @@ void keyUp(unsigned char key, int x, int y) {
 
 }
 
+// whatever glutInit leaves of the command line
+void parseArgs(int argc, char** argv) {
+	set_import_profile(IMPORT_PROFILE);
+	for (int i = 1; i < argc; i++) {
+		if (0 == strcmp(argv[i], "-import") && i + 1 < argc) {
+			int profile;
+			if (parse_import_profile(argv[++i], profile)) {
+				set_import_profile(profile);
+			} else {
+				fprintf(stderr, "WARNING. unknown import profile %s, use fast or quality\n", argv[i]);
+			}
+		} else {
+			fprintf(stderr, "WARNING. ignoring argument %s\n", argv[i]);
+		}
+	}
+	printf("import profile: %s\n", import_profile_name(get_import_profile()));
+}
+
 int main(int argc, char** argv) {
 
 	// Set up the window
 	glutInit(&argc, argv);
+	parseArgs(argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
 	glutInitWindowSize(width, height);
 	glutCreateWindow("Hello Triangle");
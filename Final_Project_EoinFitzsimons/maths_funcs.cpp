@@ -1,108 +1,16 @@
 #include "maths_funcs.h"
+#include <float.h>
 #include <stdio.h>
+#include <string.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
-
-/*-----------------------------------CONSTRUCTORS-------------------------------------*/
-
-vec2::vec2() {}
-
-vec2::vec2(float x, float y) {
-	v[0] = x;
-	v[1] = y;
-}
-
-vec3::vec3() {}
-
-vec3::vec3(float x, float y, float z) {
-	v[0] = x;
-	v[1] = y;
-	v[2] = z;
-}
-
-vec3::vec3(const vec2& vv, float z) {
-	v[0] = vv.v[0];
-	v[1] = vv.v[1];
-	v[2] = z;
-}
-
-vec3::vec3(const vec4& vv) {
-	v[0] = vv.v[0];
-	v[1] = vv.v[1];
-	v[2] = vv.v[2];
-}
-
-vec4::vec4() {}
-
-vec4::vec4(float x, float y, float z, float w) {
-	v[0] = x;
-	v[1] = y;
-	v[2] = z;
-	v[3] = w;
-}
-
-vec4::vec4(const vec2& vv, float z, float w) {
-	v[0] = vv.v[0];
-	v[1] = vv.v[1];
-	v[2] = z;
-	v[3] = w;
-}
-
-vec4::vec4(const vec3& vv, float w) {
-	v[0] = vv.v[0];
-	v[1] = vv.v[1];
-	v[2] = vv.v[2];
-	v[3] = w;
-}
-
-mat3::mat3() {}
-
-// note: entered in rows, but stored in columns
-mat3::mat3(float a, float b, float c,
-	float d, float e, float f,
-	float g, float h, float i) {
-	m[0] = a;
-	m[1] = d;
-	m[2] = g;
-	m[3] = b;
-	m[4] = e;
-	m[5] = h;
-	m[6] = c;
-	m[7] = f;
-	m[8] = i;
-}
-
-mat4::mat4() {}
-
-// note: entered in rows, but stored in columns
-mat4::mat4(float a, float b, float c, float d,
-	float e, float f, float g, float h,
-	float i, float j, float k, float l,
-	float mm, float n, float o, float p) {
-	m[0] = a;
-	m[1] = e;
-	m[2] = i;
-	m[3] = mm;
-	m[4] = b;
-	m[5] = f;
-	m[6] = j;
-	m[7] = n;
-	m[8] = c;
-	m[9] = g;
-	m[10] = k;
-	m[11] = o;
-	m[12] = d;
-	m[13] = h;
-	m[14] = l;
-	m[15] = p;
-}
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
 
 /*----------------------------------PRINT FUNCTIONS-----------------------------------*/
 
-float radians(float x) {
-	return float(x * ONE_DEG_IN_RAD);
-}
-
 void print(const vec2& v) {
 	printf("[%.2f, %.2f]\n", v.v[0], v.v[1]);
 }
@@ -130,224 +38,8 @@ void print(const mat4& m) {
 	printf("[%.2f][%.2f][%.2f][%.2f]\n", m.m[3], m.m[7], m.m[11], m.m[15]);
 }
 
-/*---------------------------------VECTOR FUNCTIONS-----------------------------------*/
-
-float length(const vec3& v) {
-	return sqrt(v.v[0] * v.v[0] + v.v[1] * v.v[1] + v.v[2] * v.v[2]);
-}
-
-float length2(const vec3& v) {
-	return v.v[0] * v.v[0] + v.v[1] * v.v[1] + v.v[2] * v.v[2];
-}
-
-vec3 normalise(const vec3& v) {
-	vec3 vb;
-	float l = length(v);
-	if (0.0f == l) {
-		return vec3(0.0f, 0.0f, 0.0f);
-	}
-	vb.v[0] = v.v[0] / l;
-	vb.v[1] = v.v[1] / l;
-	vb.v[2] = v.v[2] / l;
-	return vb;
-}
-
-vec3 vec3::operator+ (const vec3& rhs) {
-	vec3 vc;
-	vc.v[0] = v[0] + rhs.v[0];
-	vc.v[1] = v[1] + rhs.v[1];
-	vc.v[2] = v[2] + rhs.v[2];
-	return vc;
-}
-
-vec3& vec3::operator+= (const vec3& rhs) {
-	v[0] += rhs.v[0];
-	v[1] += rhs.v[1];
-	v[2] += rhs.v[2];
-	return *this; // return self
-}
-
-vec3 vec3::operator- (const vec3& rhs) {
-	vec3 vc;
-	vc.v[0] = v[0] - rhs.v[0];
-	vc.v[1] = v[1] - rhs.v[1];
-	vc.v[2] = v[2] - rhs.v[2];
-	return vc;
-}
-
-vec3& vec3::operator-= (const vec3& rhs) {
-	v[0] -= rhs.v[0];
-	v[1] -= rhs.v[1];
-	v[2] -= rhs.v[2];
-	return *this;
-}
-
-vec3 vec3::operator+ (float rhs) {
-	vec3 vc;
-	vc.v[0] = v[0] + rhs;
-	vc.v[1] = v[1] + rhs;
-	vc.v[2] = v[2] + rhs;
-	return vc;
-}
-
-vec3 vec3::operator- (float rhs) {
-	vec3 vc;
-	vc.v[0] = v[0] - rhs;
-	vc.v[1] = v[1] - rhs;
-	vc.v[2] = v[2] - rhs;
-	return vc;
-}
-
-vec3 vec3::operator* (float rhs) {
-	vec3 vc;
-	vc.v[0] = v[0] * rhs;
-	vc.v[1] = v[1] * rhs;
-	vc.v[2] = v[2] * rhs;
-	return vc;
-}
-
-vec3 vec3::operator/ (float rhs) {
-	vec3 vc;
-	vc.v[0] = v[0] / rhs;
-	vc.v[1] = v[1] / rhs;
-	vc.v[2] = v[2] / rhs;
-	return vc;
-}
-
-vec3& vec3::operator*= (float rhs) {
-	v[0] = v[0] * rhs;
-	v[1] = v[1] * rhs;
-	v[2] = v[2] * rhs;
-	return *this;
-}
-
-vec3& vec3::operator= (const vec3& rhs) {
-	v[0] = rhs.v[0];
-	v[1] = rhs.v[1];
-	v[2] = rhs.v[2];
-	return *this;
-}
-
-float dot(const vec3& a, const vec3& b) {
-	return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
-}
-
-vec3 cross(const vec3& a, const vec3& b) {
-	float x = a.v[1] * b.v[2] - a.v[2] * b.v[1];
-	float y = a.v[2] * b.v[0] - a.v[0] * b.v[2];
-	float z = a.v[0] * b.v[1] - a.v[1] * b.v[0];
-	return vec3(x, y, z);
-}
-
-float get_squared_dist(vec3 from, vec3 to) {
-	float x = (to.v[0] - from.v[0]) * (to.v[0] - from.v[0]);
-	float y = (to.v[1] - from.v[1]) * (to.v[1] - from.v[1]);
-	float z = (to.v[2] - from.v[2]) * (to.v[2] - from.v[2]);
-	return x + y + z;
-}
-
-/* converts an un-normalised direction into a heading in degrees
-NB i suspect that the z is backwards here but i've used in in
-several places like this. d'oh!
-*/
-float direction_to_heading(vec3 d) {
-	return atan2(-d.v[0], -d.v[2]) * ONE_RAD_IN_DEG;
-}
-
-vec3 heading_to_direction(float degrees) {
-	float rad = degrees * ONE_DEG_IN_RAD;
-	return vec3(-sin(rad), 0.0f, -cos(rad));
-}
-
 /*---------------------------------MATRIX FUNCTIONS-----------------------------------*/
 
-mat3 zero_mat3() {
-	return mat3(
-		0.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 0.0f
-	);
-}
-
-mat3 identity_mat3() {
-	return mat3(
-		1.0f, 0.0f, 0.0f,
-		0.0f, 1.0f, 0.0f,
-		0.0f, 0.0f, 1.0f
-	);
-}
-
-mat4 zero_mat4() {
-	return mat4(
-		0.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 0.0f, 0.0f
-	);
-}
-
-mat4 identity_mat4() {
-	return mat4(
-		1.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, 1.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 1.0f, 0.0f,
-		0.0f, 0.0f, 0.0f, 1.0f
-	);
-}
-
-/* mat4 array layout
-0 4 8  12
-1 5 9  13
-2 6 10 14
-3 7 11 15
-*/
-
-vec4 mat4::operator* (const vec4& rhs) {
-	float x = m[0] * rhs.v[0] + m[4] * rhs.v[1] + m[8] * rhs.v[2] + m[12] * rhs.v[3]; // 0x + 4y + 8z + 12w
-	float y = m[1] * rhs.v[0] + m[5] * rhs.v[1] + m[9] * rhs.v[2] + m[13] * rhs.v[3]; // 1x + 5y + 9z + 13w
-	float z = m[2] * rhs.v[0] + m[6] * rhs.v[1] + m[10] * rhs.v[2] + m[14] * rhs.v[3]; // 2x + 6y + 10z + 14w
-	float w = m[3] * rhs.v[0] + m[7] * rhs.v[1] + m[11] * rhs.v[2] + m[15] * rhs.v[3]; // 3x + 7y + 11z + 15w
-	return vec4(x, y, z, w);
-}
-/*
-mat4 mat4::operator* (const mat4& rhs) {
-mat4 r = zero_mat4 ();
-int r_index = 0;
-for (int col = 0; col < 4; col++) {
-for (int row = 0; row < 4; row++) {
-float sum = 0.0f;
-for (int i = 0; i < 4; i++) {
-sum += m[i + col * 4] * rhs.m[row + i * 4];
-}
-r.m[r_index] = sum;
-r_index++;
-}
-}
-return r;
-}*/
-mat4 mat4::operator* (const mat4& rhs) {
-	mat4 r = zero_mat4();
-	int r_index = 0;
-	for (int col = 0; col < 4; col++) {
-		for (int row = 0; row < 4; row++) {
-			float sum = 0.0f;
-			for (int i = 0; i < 4; i++) {
-				sum += rhs.m[i + col * 4] * m[row + i * 4];
-			}
-			r.m[r_index] = sum;
-			r_index++;
-		}
-	}
-	return r;
-}
-
-mat4& mat4::operator= (const mat4& rhs) {
-	for (int i = 0; i < 16; i++) {
-		m[i] = rhs.m[i];
-	}
-	return *this;
-}
-
 // returns a scalar value with the determinant for a 4x4 matrix
 // see http://www.euclideanspace.com/maths/algebra/matrix/functions/determinant/fourD/index.htm
 float determinant(const mat4& mm) {
@@ -377,9 +69,9 @@ float determinant(const mat4& mm) {
 		mm.m[0] * mm.m[5] * mm.m[10] * mm.m[15];
 }
 
-// returns a 16-element array that is the inverse of a 16-element array (4x4 matrix)
-// see http://www.euclideanspace.com/maths/algebra/matrix/functions/inverse/fourD/index.htm
-mat4 inverse(const mat4& mm) {
+// the plain cofactor expansion. inverse() uses this when there is no SIMD, and
+// the benchmark below times it against the SIMD version
+static mat4 inverse_scalar(const mat4& mm) {
 	float det = determinant(mm);
 	// there is no inverse if determinant is zero (not likely unless scale is broken)
 	if (0.0f == det) {
@@ -407,8 +99,82 @@ mat4 inverse(const mat4& mm) {
 	);
 }
 
-// returns a 16-element array flipped on the main diagonal
-mat4 transpose(const mat4& mm) {
+// returns a 16-element array that is the inverse of a 16-element array (4x4 matrix)
+// see http://www.euclideanspace.com/maths/algebra/matrix/functions/inverse/fourD/index.htm
+mat4 inverse(const mat4& mm) {
+#ifdef MATHS_SSE
+	// 2x2 block version of the same cofactor expansion. the matrix is split into
+	// | A B |
+	// | C D | blocks, each held in one register as (a00 a01 a10 a11) of the row
+	// major view (the inverse of the transpose is the transpose of the inverse,
+	// so the block maths does not care that we are actually column major)
+	__m128 c0 = _mm_loadu_ps(&mm.m[0]);
+	__m128 c1 = _mm_loadu_ps(&mm.m[4]);
+	__m128 c2 = _mm_loadu_ps(&mm.m[8]);
+	__m128 c3 = _mm_loadu_ps(&mm.m[12]);
+	__m128 A = _mm_movelh_ps(c0, c1);
+	__m128 B = _mm_movehl_ps(c1, c0);
+	__m128 C = _mm_movelh_ps(c2, c3);
+	__m128 D = _mm_movehl_ps(c3, c2);
+	// determinants of the four blocks as (|A| |B| |C| |D|)
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0)))
+	);
+	__m128 det_a = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128 det_b = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128 det_c = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(2, 2, 2, 2));
+	__m128 det_d = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(3, 3, 3, 3));
+	// adjugate products (D#)C and (A#)B
+	__m128 d_c = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(D, D, _MM_SHUFFLE(0, 0, 3, 3)), C),
+		_mm_mul_ps(_mm_shuffle_ps(D, D, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(C, C, _MM_SHUFFLE(1, 0, 3, 2)))
+	);
+	__m128 a_b = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(0, 0, 3, 3)), B),
+		_mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(B, B, _MM_SHUFFLE(1, 0, 3, 2)))
+	);
+	// X# = |D|A - B(D#C), W# = |A|D - C(A#B)
+	__m128 x_ = _mm_sub_ps(_mm_mul_ps(det_d, A), _mm_add_ps(
+		_mm_mul_ps(B, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(B, B, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(1, 2, 1, 2)))));
+	__m128 w_ = _mm_sub_ps(_mm_mul_ps(det_a, D), _mm_add_ps(
+		_mm_mul_ps(C, _mm_shuffle_ps(a_b, a_b, _MM_SHUFFLE(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(C, C, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(a_b, a_b, _MM_SHUFFLE(1, 2, 1, 2)))));
+	// Y# = |B|C - D(A#B)#, Z# = |C|B - A(D#C)#
+	__m128 y_ = _mm_sub_ps(_mm_mul_ps(det_b, C), _mm_sub_ps(
+		_mm_mul_ps(D, _mm_shuffle_ps(a_b, a_b, _MM_SHUFFLE(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(D, D, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(a_b, a_b, _MM_SHUFFLE(1, 2, 1, 2)))));
+	__m128 z_ = _mm_sub_ps(_mm_mul_ps(det_c, B), _mm_sub_ps(
+		_mm_mul_ps(A, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(1, 2, 1, 2)))));
+	// |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+	__m128 tr = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 1, 2, 0)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+	__m128 det_m = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+	if (0.0f == _mm_cvtss_f32(det_m)) {
+		printf("WARNING. matrix has no determinant. can not invert");
+		return mm;
+	}
+	__m128 r_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det_m);
+	x_ = _mm_mul_ps(x_, r_det);
+	y_ = _mm_mul_ps(y_, r_det);
+	z_ = _mm_mul_ps(z_, r_det);
+	w_ = _mm_mul_ps(w_, r_det);
+	// undo the adjugate swizzle on the way out
+	mat4 r;
+	_mm_storeu_ps(&r.m[0], _mm_shuffle_ps(x_, y_, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(&r.m[4], _mm_shuffle_ps(x_, y_, _MM_SHUFFLE(0, 2, 0, 2)));
+	_mm_storeu_ps(&r.m[8], _mm_shuffle_ps(z_, w_, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(&r.m[12], _mm_shuffle_ps(z_, w_, _MM_SHUFFLE(0, 2, 0, 2)));
+	return r;
+#else
+	return inverse_scalar(mm);
+#endif
+}
+
+static mat4 transpose_scalar(const mat4& mm) {
 	return mat4(
 		mm.m[0], mm.m[1], mm.m[2], mm.m[3],
 		mm.m[4], mm.m[5], mm.m[6], mm.m[7],
@@ -417,60 +183,338 @@ mat4 transpose(const mat4& mm) {
 	);
 }
 
-/*--------------------------------AFFINE MATRIX FUNCTIONS-----------------------------*/
+// returns a 16-element array flipped on the main diagonal
+mat4 transpose(const mat4& mm) {
+#ifdef MATHS_SSE
+	__m128 c0 = _mm_loadu_ps(&mm.m[0]);
+	__m128 c1 = _mm_loadu_ps(&mm.m[4]);
+	__m128 c2 = _mm_loadu_ps(&mm.m[8]);
+	__m128 c3 = _mm_loadu_ps(&mm.m[12]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	mat4 r;
+	_mm_storeu_ps(&r.m[0], c0);
+	_mm_storeu_ps(&r.m[4], c1);
+	_mm_storeu_ps(&r.m[8], c2);
+	_mm_storeu_ps(&r.m[12], c3);
+	return r;
+#else
+	return transpose_scalar(mm);
+#endif
+}
 
-// translate a 4d matrix with xyz array
-mat4 translate(const mat4& m, const vec3& v) {
-	mat4 m_t = identity_mat4();
-	m_t.m[12] = v.v[0];
-	m_t.m[13] = v.v[1];
-	m_t.m[14] = v.v[2];
-	return m_t * m;
+/*--------------------------------AFFINE TRANSFORM TYPE-------------------------------*/
+
+/* affine array layout (rows, unlike mat4)
+0 1 2  3
+4 5 6  7
+8 9 10 11
+(0 0 0 1)
+the inverse of the upper 3x3 has the cross products of its rows as columns:
+inverse = [r1 x r2 | r2 x r0 | r0 x r1] / (r0 . (r1 x r2))
+so the normal matrix (inverse transpose) is those cross products as rows
+*/
+
+#ifdef MATHS_SSE
+// cross product of the xyz parts. lane 3 of the result is always 0
+static inline __m128 cross_ps(__m128 a, __m128 b) {
+	__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif
+
+// about 40 multiplies against the ~200 of the general mat4 inverse
+affine inverse(const affine& a) {
+	affine r;
+#ifdef MATHS_SSE
+	__m128 r0 = _mm_loadu_ps(&a.m[0]);
+	__m128 r1 = _mm_loadu_ps(&a.m[4]);
+	__m128 r2 = _mm_loadu_ps(&a.m[8]);
+	__m128 c0 = cross_ps(r1, r2);
+	__m128 c1 = cross_ps(r2, r0);
+	__m128 c2 = cross_ps(r0, r1);
+	// r0 . c0, lane 3 of c0 is zero so the translation drops out
+	__m128 d = _mm_mul_ps(r0, c0);
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+	float det = _mm_cvtss_f32(d);
+	if (0.0f == det) {
+		printf("WARNING. matrix has no determinant. can not invert");
+		return a;
+	}
+	__m128 inv_det = _mm_set1_ps(1.0f / det);
+	c0 = _mm_mul_ps(c0, inv_det);
+	c1 = _mm_mul_ps(c1, inv_det);
+	c2 = _mm_mul_ps(c2, inv_det);
+	// translation = -(inverse 3x3 * t), with the inverse's columns being c0 c1 c2
+	__m128 t = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(c0, _mm_set1_ps(a.m[3])),
+		_mm_mul_ps(c1, _mm_set1_ps(a.m[7]))),
+		_mm_mul_ps(c2, _mm_set1_ps(a.m[11])));
+	t = _mm_sub_ps(_mm_setzero_ps(), t);
+	// columns -> rows, with the translation landing in the last column
+	_MM_TRANSPOSE4_PS(c0, c1, c2, t);
+	_mm_storeu_ps(&r.m[0], c0);
+	_mm_storeu_ps(&r.m[4], c1);
+	_mm_storeu_ps(&r.m[8], c2);
+#else
+	const float* m = a.m;
+	// cross products of the rows, c[i * 3 + k] = column i of the inverse
+	float c[9] = {
+		m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+		m[9] * m[2] - m[10] * m[1], m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0],
+		m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4]
+	};
+	float det = m[0] * c[0] + m[1] * c[1] + m[2] * c[2];
+	if (0.0f == det) {
+		printf("WARNING. matrix has no determinant. can not invert");
+		return a;
+	}
+	float inv_det = 1.0f / det;
+	for (int row = 0; row < 3; row++) {
+		r.m[row * 4] = c[row] * inv_det;
+		r.m[row * 4 + 1] = c[3 + row] * inv_det;
+		r.m[row * 4 + 2] = c[6 + row] * inv_det;
+		r.m[row * 4 + 3] = -(r.m[row * 4] * m[3] + r.m[row * 4 + 1] * m[7] + r.m[row * 4 + 2] * m[11]);
+	}
+#endif
+	return r;
 }
 
-// rotate around x axis by an angle in degrees
-mat4 rotate_x_deg(const mat4& m, float deg) {
-	// convert to radians
-	float rad = deg * ONE_DEG_IN_RAD;
-	mat4 m_r = identity_mat4();
-	m_r.m[5] = cos(rad);
-	m_r.m[9] = -sin(rad);
-	m_r.m[6] = sin(rad);
-	m_r.m[10] = cos(rad);
-	return m_r * m;
+affine inverse_rigid(const affine& a) {
+	affine r;
+#ifdef MATHS_SSE
+	__m128 r0 = _mm_loadu_ps(&a.m[0]);
+	__m128 r1 = _mm_loadu_ps(&a.m[4]);
+	__m128 r2 = _mm_loadu_ps(&a.m[8]);
+	// -(R^T * t): the columns of R^T are our rows
+	__m128 t = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(r0, _mm_set1_ps(a.m[3])),
+		_mm_mul_ps(r1, _mm_set1_ps(a.m[7]))),
+		_mm_mul_ps(r2, _mm_set1_ps(a.m[11])));
+	t = _mm_sub_ps(_mm_setzero_ps(), t);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, t);
+	_mm_storeu_ps(&r.m[0], r0);
+	_mm_storeu_ps(&r.m[4], r1);
+	_mm_storeu_ps(&r.m[8], r2);
+#else
+	for (int row = 0; row < 3; row++) {
+		r.m[row * 4] = a.m[row];
+		r.m[row * 4 + 1] = a.m[4 + row];
+		r.m[row * 4 + 2] = a.m[8 + row];
+		r.m[row * 4 + 3] = -(a.m[row] * a.m[3] + a.m[4 + row] * a.m[7] + a.m[8 + row] * a.m[11]);
+	}
+#endif
+	return r;
 }
 
-// rotate around y axis by an angle in degrees
-mat4 rotate_y_deg(const mat4& m, float deg) {
-	// convert to radians
-	float rad = deg * ONE_DEG_IN_RAD;
-	mat4 m_r = identity_mat4();
-	m_r.m[0] = cos(rad);
-	m_r.m[8] = sin(rad);
-	m_r.m[2] = -sin(rad);
-	m_r.m[10] = cos(rad);
-	return m_r * m;
+mat3 normal_matrix(const affine& a) {
+	const float* m = a.m;
+	float c[9] = {
+		m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+		m[9] * m[2] - m[10] * m[1], m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0],
+		m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4]
+	};
+	float det = m[0] * c[0] + m[1] * c[1] + m[2] * c[2];
+	if (0.0f == det) {
+		printf("WARNING. matrix has no determinant. can not invert");
+		return identity_mat3();
+	}
+	float inv_det = 1.0f / det;
+	// the cross products are the rows of the normal matrix, entered in rows
+	return mat3(
+		c[0] * inv_det, c[1] * inv_det, c[2] * inv_det,
+		c[3] * inv_det, c[4] * inv_det, c[5] * inv_det,
+		c[6] * inv_det, c[7] * inv_det, c[8] * inv_det
+	);
 }
 
-// rotate around z axis by an angle in degrees
-mat4 rotate_z_deg(const mat4& m, float deg) {
-	// convert to radians
-	float rad = deg * ONE_DEG_IN_RAD;
-	mat4 m_r = identity_mat4();
-	m_r.m[0] = cos(rad);
-	m_r.m[4] = -sin(rad);
-	m_r.m[1] = sin(rad);
-	m_r.m[5] = cos(rad);
-	return m_r * m;
+/*---------------------------------BATCH FUNCTIONS------------------------------------*/
+
+// points are treated as (x, y, z, 1) and directions as (x, y, z, 0). the w row
+// of the matrix is ignored, so there is no perspective divide here
+static void transform_vec3s(const mat4& m, const vec3* in, vec3* out, int count, int out_stride, float w) {
+	char* dst = (char*)out;
+	if (0 == out_stride) {
+		out_stride = sizeof(vec3);
+	}
+#ifdef MATHS_SSE
+	__m128 c0 = _mm_loadu_ps(&m.m[0]);
+	__m128 c1 = _mm_loadu_ps(&m.m[4]);
+	__m128 c2 = _mm_loadu_ps(&m.m[8]);
+	__m128 c3 = _mm_mul_ps(_mm_loadu_ps(&m.m[12]), _mm_set1_ps(w));
+	for (int i = 0; i < count; i++) {
+		__m128 r = _mm_mul_ps(c0, _mm_set1_ps(in[i].v[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(in[i].v[1])));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[i].v[2])));
+		r = _mm_add_ps(r, c3);
+		float* o = (float*)(dst + (size_t)i * out_stride);
+		// xy as one 64-bit store then z on its own, so we never write past the vec3
+		_mm_storel_pi((__m64*)o, r);
+		_mm_store_ss(o + 2, _mm_movehl_ps(r, r));
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		const float* p = in[i].v;
+		float* o = (float*)(dst + (size_t)i * out_stride);
+		float x = m.m[0] * p[0] + m.m[4] * p[1] + m.m[8] * p[2] + m.m[12] * w;
+		float y = m.m[1] * p[0] + m.m[5] * p[1] + m.m[9] * p[2] + m.m[13] * w;
+		float z = m.m[2] * p[0] + m.m[6] * p[1] + m.m[10] * p[2] + m.m[14] * w;
+		o[0] = x;
+		o[1] = y;
+		o[2] = z;
+	}
+#endif
 }
 
-// scale a matrix by [x, y, z]
-mat4 scale(const mat4& m, const vec3& v) {
-	mat4 a = identity_mat4();
-	a.m[0] = v.v[0];
-	a.m[5] = v.v[1];
-	a.m[10] = v.v[2];
-	return a * m;
+void transform_points(const mat4& m, const vec3* in, vec3* out, int count, int out_stride) {
+	transform_vec3s(m, in, out, count, out_stride, 1.0f);
+}
+
+void transform_directions(const mat4& m, const vec3* in, vec3* out, int count, int out_stride) {
+	transform_vec3s(m, in, out, count, out_stride, 0.0f);
+}
+
+void transform_vec4s(const mat4& m, const vec4* in, vec4* out, int count, int out_stride) {
+	char* dst = (char*)out;
+	if (0 == out_stride) {
+		out_stride = sizeof(vec4);
+	}
+#ifdef MATHS_AVX
+	// two vectors per iteration, each lane holding one column pair
+	__m128 c0 = _mm_loadu_ps(&m.m[0]);
+	__m128 c1 = _mm_loadu_ps(&m.m[4]);
+	__m128 c2 = _mm_loadu_ps(&m.m[8]);
+	__m128 c3 = _mm_loadu_ps(&m.m[12]);
+	__m256 a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c0, 1);
+	__m256 a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c1), c1, 1);
+	__m256 a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c2, 1);
+	__m256 a3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c3), c3, 1);
+	int i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m256 v = _mm256_loadu_ps(in[i].v);
+		__m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(v, v, 0x00));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(v, v, 0x55)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(v, v, 0xAA)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(v, v, 0xFF)));
+		_mm_storeu_ps((float*)(dst + (size_t)i * out_stride), _mm256_castps256_ps128(r));
+		_mm_storeu_ps((float*)(dst + (size_t)(i + 1) * out_stride), _mm256_extractf128_ps(r, 1));
+	}
+	for (; i < count; i++) {
+		*(vec4*)(dst + (size_t)i * out_stride) = m * in[i];
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		*(vec4*)(dst + (size_t)i * out_stride) = m * in[i];
+	}
+#endif
+}
+
+void transform_points_mt(const mat4& m, const vec3* in, vec3* out, int count, int out_stride, int num_threads) {
+	// below this many points per thread the thread start-up costs more than it saves
+	const int min_per_thread = 16384;
+	if (num_threads <= 0) {
+		num_threads = (int)std::thread::hardware_concurrency();
+	}
+	if (num_threads > count / min_per_thread) {
+		num_threads = count / min_per_thread;
+	}
+	if (num_threads <= 1) {
+		transform_points(m, in, out, count, out_stride);
+		return;
+	}
+	if (0 == out_stride) {
+		out_stride = sizeof(vec3);
+	}
+	int chunk = (count + num_threads - 1) / num_threads;
+	std::vector<std::thread> workers;
+	for (int t = 1; t < num_threads; t++) {
+		int first = t * chunk;
+		int n = (first + chunk > count) ? count - first : chunk;
+		vec3* dst = (vec3*)((char*)out + (size_t)first * out_stride);
+		workers.push_back(std::thread(transform_points, std::cref(m), in + first, dst, n, out_stride));
+	}
+	// the calling thread does the first chunk itself
+	transform_points(m, in, out, chunk, out_stride);
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+}
+
+void normalise_vec3s(const vec3* in, vec3* out, int count, int mode) {
+	int i = 0;
+#ifdef MATHS_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 smallest = _mm_set1_ps(FLT_MIN);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 three = _mm_set1_ps(3.0f);
+	// 4 vec3s are 3 registers: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = _mm_loadu_ps(in[i].v);
+		__m128 b = _mm_loadu_ps(in[i].v + 4);
+		__m128 c = _mm_loadu_ps(in[i].v + 8);
+		// pull out x, y and z of all 4 to get the squared lengths
+		__m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+			_mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+			_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 nonzero = _mm_cmpneq_ps(len2, zero);
+		// rsqrt of a denormal is inf, so a group with any of those in it goes
+		// the precise way
+		__m128 normal = _mm_cmpge_ps(len2, smallest);
+		__m128 sa, sb, sc;
+		if (NORMALISE_PRECISE == mode || _mm_movemask_ps(_mm_andnot_ps(normal, nonzero))) {
+			// divide by the length like normalise(vec3). zero vectors divide by 1
+			__m128 l = _mm_sqrt_ps(len2);
+			l = _mm_or_ps(_mm_and_ps(nonzero, l), _mm_andnot_ps(nonzero, one));
+			sa = _mm_div_ps(a, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 0, 0, 0)));
+			sb = _mm_div_ps(b, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 2, 1, 1)));
+			sc = _mm_div_ps(c, _mm_shuffle_ps(l, l, _MM_SHUFFLE(3, 3, 3, 2)));
+		} else {
+			// rsqrt estimate plus one Newton step: r = r * (3 - len2 * r * r) / 2.
+			// rsqrt(0) is inf, so zero vectors get masked to a scale of 0
+			__m128 r = _mm_rsqrt_ps(len2);
+			r = _mm_mul_ps(_mm_mul_ps(half, r), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(len2, r), r)));
+			r = _mm_and_ps(normal, r);
+			sa = _mm_mul_ps(a, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 0, 0, 0)));
+			sb = _mm_mul_ps(b, _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 1, 1)));
+			sc = _mm_mul_ps(c, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 2)));
+		}
+		_mm_storeu_ps(out[i].v, sa);
+		_mm_storeu_ps(out[i].v + 4, sb);
+		_mm_storeu_ps(out[i].v + 8, sc);
+	}
+#else
+	(void)mode;
+#endif
+	// leftovers, and everything without SSE. there's no cheap estimate to start
+	// from in scalar code so both modes are the exact version
+	for (; i < count; i++) {
+		out[i] = normalise(in[i]);
+	}
+}
+
+void vec3s_to_vec2s(const vec3* in, vec2* out, int count) {
+	int i = 0;
+#ifdef MATHS_SSE
+	// 4 vec3s in: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+	// 4 vec2s out: x0 y0 x1 y1 | x2 y2 x3 y3
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = _mm_loadu_ps(in[i].v);
+		__m128 b = _mm_loadu_ps(in[i].v + 4);
+		__m128 c = _mm_loadu_ps(in[i].v + 8);
+		__m128 x1y1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));
+		_mm_storeu_ps(out[i].v, _mm_shuffle_ps(a, x1y1, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(out[i].v + 4, _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)));
+	}
+#endif
+	for (; i < count; i++) {
+		out[i] = vec2(in[i].v[0], in[i].v[1]);
+	}
 }
 
 /*------------------------------3D SCENE MATRIX FUNCTIONS-----------------------------*/
@@ -534,6 +578,337 @@ mat4 perspective(float fovy, float aspect, float near, float far) {
 	return m;
 }
 
+/*------------------------------VERTEX PACKING FUNCTIONS------------------------------*/
+
+unsigned short float_to_half(float f) {
+	unsigned int x;
+	memcpy(&x, &f, 4);
+	unsigned int sign = (x >> 16) & 0x8000;
+	unsigned int mag = x & 0x7fffffff;
+	if (mag >= 0x7f800000) {
+		// infinity stays infinity, NaN stays a (quiet) NaN
+		return (unsigned short)(sign | 0x7c00 | (mag > 0x7f800000 ? 0x200 : 0));
+	}
+	if (mag >= 0x477ff000) {
+		// 65520 and up round past the largest half (65504)
+		return (unsigned short)(sign | 0x7c00);
+	}
+	if (mag < 0x38800000) {
+		// below the smallest normal half, 2^-14
+		if (mag < 0x33000000) {
+			return (unsigned short)sign;
+		}
+		unsigned int e = mag >> 23;
+		unsigned int m = (mag & 0x7fffff) | 0x800000;
+		unsigned int shift = 126 - e;
+		unsigned int h = m >> shift;
+		unsigned int rem = m & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if (rem > halfway || (rem == halfway && (h & 1))) {
+			h++;
+		}
+		return (unsigned short)(sign | h);
+	}
+	// rebias the exponent and drop 13 bits of mantissa. a carry out of the
+	// mantissa correctly bumps the exponent
+	unsigned int h = (mag >> 13) - ((127 - 15) << 10);
+	unsigned int rem = mag & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+		h++;
+	}
+	return (unsigned short)(sign | h);
+}
+
+float half_to_float(unsigned short h) {
+	unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+	unsigned int e = (h >> 10) & 0x1f;
+	unsigned int m = h & 0x3ff;
+	unsigned int x;
+	if (0 == e) {
+		if (0 == m) {
+			x = sign;
+		} else {
+			// denormal: shift it up until it has a leading 1
+			e = 127 - 14;
+			while (!(m & 0x400)) {
+				m <<= 1;
+				e--;
+			}
+			x = sign | (e << 23) | ((m & 0x3ff) << 13);
+		}
+	} else if (31 == e) {
+		x = sign | 0x7f800000 | (m << 13);
+	} else {
+		x = sign | ((e + 127 - 15) << 23) | (m << 13);
+	}
+	float f;
+	memcpy(&f, &x, 4);
+	return f;
+}
+
+static float sign_not_zero(float v) {
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+void oct_encode(const vec3& n, short out[2]) {
+	float l1 = fabsf(n.v[0]) + fabsf(n.v[1]) + fabsf(n.v[2]);
+	if (l1 <= 0.0f) {
+		out[0] = out[1] = 0;
+		return;
+	}
+	float x = n.v[0] / l1;
+	float y = n.v[1] / l1;
+	if (n.v[2] < 0.0f) {
+		// fold the lower half out over the corners
+		float ox = x;
+		x = (1.0f - fabsf(y)) * sign_not_zero(ox);
+		y = (1.0f - fabsf(ox)) * sign_not_zero(y);
+	}
+	float fx = floorf(x * 32767.0f);
+	float fy = floorf(y * 32767.0f);
+	// compared by distance rather than dot, which can't tell candidates this
+	// close together apart in float
+	float best = 1e30f;
+	for (int i = 0; i < 4; i++) {
+		float cx = fx + (float)(i & 1);
+		float cy = fy + (float)(i >> 1);
+		cx = cx < -32767.0f ? -32767.0f : (cx > 32767.0f ? 32767.0f : cx);
+		cy = cy < -32767.0f ? -32767.0f : (cy > 32767.0f ? 32767.0f : cy);
+		vec3 diff = oct_decode((short)cx, (short)cy) - n;
+		float d = dot(diff, diff);
+		if (d < best) {
+			best = d;
+			out[0] = (short)cx;
+			out[1] = (short)cy;
+		}
+	}
+}
+
+vec3 oct_decode(short x, short y) {
+	float ex = (float)x / 32767.0f;
+	float ey = (float)y / 32767.0f;
+	ex = ex < -1.0f ? -1.0f : ex;
+	ey = ey < -1.0f ? -1.0f : ey;
+	vec3 v(ex, ey, 1.0f - fabsf(ex) - fabsf(ey));
+	if (v.v[2] < 0.0f) {
+		float ox = v.v[0];
+		v.v[0] = (1.0f - fabsf(v.v[1])) * sign_not_zero(ox);
+		v.v[1] = (1.0f - fabsf(ox)) * sign_not_zero(v.v[1]);
+	}
+	return normalise(v);
+}
+
+/*-----------------------------BOUNDING VOLUME FUNCTIONS------------------------------*/
+
+aabb aabb_from_points(const vec3* pts, int count) {
+	if (count <= 0) {
+		return aabb(vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, 0.0f));
+	}
+	aabb b(pts[0], pts[0]);
+	for (int i = 1; i < count; i++) {
+		for (int k = 0; k < 3; k++) {
+			if (pts[i].v[k] < b.mn.v[k]) {
+				b.mn.v[k] = pts[i].v[k];
+			}
+			if (pts[i].v[k] > b.mx.v[k]) {
+				b.mx.v[k] = pts[i].v[k];
+			}
+		}
+	}
+	return b;
+}
+
+sphere sphere_from_points(const vec3* pts, int count) {
+	aabb b = aabb_from_points(pts, count);
+	vec3 c = (b.mn + b.mx) * 0.5f;
+	float r2 = 0.0f;
+	for (int i = 0; i < count; i++) {
+		float d2 = get_squared_dist(c, pts[i]);
+		if (d2 > r2) {
+			r2 = d2;
+		}
+	}
+	return sphere(c, sqrt(r2));
+}
+
+// Arvo's method: the new centre is the transformed centre, and each new half
+// extent is the old ones weighted by the absolute values of that matrix row
+aabb transform_aabb(const mat4& m, const aabb& b) {
+	vec3 c = (b.mn + b.mx) * 0.5f;
+	vec3 e = (b.mx - b.mn) * 0.5f;
+	vec3 nc, ne;
+	for (int r = 0; r < 3; r++) {
+		nc.v[r] = m.m[r] * c.v[0] + m.m[4 + r] * c.v[1] + m.m[8 + r] * c.v[2] + m.m[12 + r];
+		ne.v[r] = fabs(m.m[r]) * e.v[0] + fabs(m.m[4 + r]) * e.v[1] + fabs(m.m[8 + r]) * e.v[2];
+	}
+	return aabb(nc - ne, nc + ne);
+}
+
+// Gribb and Hartmann: each clip plane is the bottom row of the matrix plus or
+// minus one of the other rows (rows are spread across the columns here)
+frustum extract_frustum(const mat4& m) {
+	frustum f;
+	for (int i = 0; i < 3; i++) {
+		for (int k = 0; k < 4; k++) {
+			float w = m.m[k * 4 + 3];
+			float a = m.m[k * 4 + i];
+			f.planes[i * 2].v[k] = w + a;
+			f.planes[i * 2 + 1].v[k] = w - a;
+		}
+	}
+	for (int i = 0; i < 6; i++) {
+		vec4& p = f.planes[i];
+		float len = sqrt(p.v[0] * p.v[0] + p.v[1] * p.v[1] + p.v[2] * p.v[2]);
+		for (int k = 0; k < 4; k++) {
+			p.v[k] /= len;
+		}
+	}
+	return f;
+}
+
+// centre c, and r = how far the volume reaches along the plane normal. outside
+// if it is entirely behind any plane, inside if it is in front of all of them
+static int classify_scalar(const frustum& f, const vec3& c, const vec3& e, float radius) {
+	int result = CULL_INSIDE;
+	for (int i = 0; i < 6; i++) {
+		const vec4& p = f.planes[i];
+		float dist = p.v[0] * c.v[0] + p.v[1] * c.v[1] + p.v[2] * c.v[2] + p.v[3];
+		float r = fabs(p.v[0]) * e.v[0] + fabs(p.v[1]) * e.v[1] + fabs(p.v[2]) * e.v[2] + radius;
+		if (dist + r < 0.0f) {
+			return CULL_OUTSIDE;
+		}
+		if (dist - r < 0.0f) {
+			result = CULL_INTERSECT;
+		}
+	}
+	return result;
+}
+
+int classify(const frustum& f, const aabb& b) {
+	return classify_scalar(f, (b.mn + b.mx) * 0.5f, (b.mx - b.mn) * 0.5f, 0.0f);
+}
+
+int classify(const frustum& f, const sphere& s) {
+	return classify_scalar(f, s.centre, vec3(0.0f, 0.0f, 0.0f), s.radius);
+}
+
+#ifdef MATHS_SSE
+/* the batch tests go one volume at a time against all of the planes at once.
+the planes are laid out a a a a a a - - | b b b ... | c ... | d ..., padded to
+eight with planes that everything is inside, so it is one AVX register per
+component or two SSE ones */
+#ifdef MATHS_AVX
+typedef __m256 plane_reg;
+#define PLANE_LANES 8
+#define preg_set1 _mm256_set1_ps
+#define preg_load _mm256_loadu_ps
+#define preg_add _mm256_add_ps
+#define preg_sub _mm256_sub_ps
+#define preg_mul _mm256_mul_ps
+#define preg_movemask(a) _mm256_movemask_ps(a)
+#define preg_lt_zero(a) _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ)
+#else
+typedef __m128 plane_reg;
+#define PLANE_LANES 4
+#define preg_set1 _mm_set1_ps
+#define preg_load _mm_loadu_ps
+#define preg_add _mm_add_ps
+#define preg_sub _mm_sub_ps
+#define preg_mul _mm_mul_ps
+#define preg_movemask(a) _mm_movemask_ps(a)
+#define preg_lt_zero(a) _mm_cmplt_ps(a, _mm_setzero_ps())
+#endif
+#define PLANE_REGS (8 / PLANE_LANES)
+
+struct frustum_regs {
+	plane_reg a[PLANE_REGS], b[PLANE_REGS], c[PLANE_REGS], d[PLANE_REGS];
+	plane_reg abs_a[PLANE_REGS], abs_b[PLANE_REGS], abs_c[PLANE_REGS];
+};
+
+static void load_frustum_regs(const frustum& f, frustum_regs& fr) {
+	float pa[8], pb[8], pc[8], pd[8], aa[8], ab[8], ac[8];
+	for (int i = 0; i < 8; i++) {
+		vec4 p = (i < 6) ? f.planes[i] : vec4(0.0f, 0.0f, 0.0f, 1e30f);
+		pa[i] = p.v[0];
+		pb[i] = p.v[1];
+		pc[i] = p.v[2];
+		pd[i] = p.v[3];
+		aa[i] = fabs(p.v[0]);
+		ab[i] = fabs(p.v[1]);
+		ac[i] = fabs(p.v[2]);
+	}
+	for (int i = 0; i < PLANE_REGS; i++) {
+		fr.a[i] = preg_load(pa + i * PLANE_LANES);
+		fr.b[i] = preg_load(pb + i * PLANE_LANES);
+		fr.c[i] = preg_load(pc + i * PLANE_LANES);
+		fr.d[i] = preg_load(pd + i * PLANE_LANES);
+		fr.abs_a[i] = preg_load(aa + i * PLANE_LANES);
+		fr.abs_b[i] = preg_load(ab + i * PLANE_LANES);
+		fr.abs_c[i] = preg_load(ac + i * PLANE_LANES);
+	}
+}
+
+// same maths as classify_scalar, eight planes wide
+static inline int classify_regs(const frustum_regs& fr, const vec3& c, const vec3& e, float radius) {
+	plane_reg cx = preg_set1(c.v[0]), cy = preg_set1(c.v[1]), cz = preg_set1(c.v[2]);
+	plane_reg ex = preg_set1(e.v[0]), ey = preg_set1(e.v[1]), ez = preg_set1(e.v[2]);
+	plane_reg rad = preg_set1(radius);
+	int outside = 0;
+	int intersect = 0;
+	for (int i = 0; i < PLANE_REGS; i++) {
+		plane_reg dist = preg_add(preg_add(preg_add(preg_mul(fr.a[i], cx), preg_mul(fr.b[i], cy)),
+			preg_mul(fr.c[i], cz)), fr.d[i]);
+		plane_reg r = preg_add(preg_add(preg_add(preg_mul(fr.abs_a[i], ex), preg_mul(fr.abs_b[i], ey)),
+			preg_mul(fr.abs_c[i], ez)), rad);
+		outside |= preg_movemask(preg_lt_zero(preg_add(dist, r)));
+		intersect |= preg_movemask(preg_lt_zero(preg_sub(dist, r)));
+	}
+	if (outside) {
+		return CULL_OUTSIDE;
+	}
+	return intersect ? CULL_INTERSECT : CULL_INSIDE;
+}
+#endif
+
+int classify_aabbs(const frustum& f, const aabb* boxes, int count, unsigned char* result) {
+	int visible = 0;
+#ifdef MATHS_SSE
+	frustum_regs fr;
+	load_frustum_regs(f, fr);
+#endif
+	for (int i = 0; i < count; i++) {
+		vec3 c = (boxes[i].mn + boxes[i].mx) * 0.5f;
+		vec3 e = (boxes[i].mx - boxes[i].mn) * 0.5f;
+#ifdef MATHS_SSE
+		int res = classify_regs(fr, c, e, 0.0f);
+#else
+		int res = classify_scalar(f, c, e, 0.0f);
+#endif
+		result[i] = (unsigned char)res;
+		visible += (res != CULL_OUTSIDE);
+	}
+	return visible;
+}
+
+int classify_spheres(const frustum& f, const sphere* spheres, int count, unsigned char* result) {
+	int visible = 0;
+	const vec3 no_extent(0.0f, 0.0f, 0.0f);
+#ifdef MATHS_SSE
+	frustum_regs fr;
+	load_frustum_regs(f, fr);
+#endif
+	for (int i = 0; i < count; i++) {
+#ifdef MATHS_SSE
+		int res = classify_regs(fr, spheres[i].centre, no_extent, spheres[i].radius);
+#else
+		int res = classify_scalar(f, spheres[i].centre, no_extent, spheres[i].radius);
+#endif
+		result[i] = (unsigned char)res;
+		visible += (res != CULL_OUTSIDE);
+	}
+	return visible;
+}
+
 
 /*------------------------------HAMILTON IN DA HOUSE!-----------------------------*/
 versor::versor() { }
@@ -671,4 +1046,603 @@ versor slerp(versor& q, versor& r, float t) {
 		result.q[i] = q.q[i] * a + r.q[i] * b;
 	}
 	return result;
-}
\ No newline at end of file
+}
+
+/*-----------------------------BATCH QUATERNION FUNCTIONS-----------------------------*/
+
+// sin(t * theta) / sin(theta) = t * (1 + b0 * (1 + b1 * (... (1 + b7))))
+// with bi = (u[i] * t * t - v[i]) * (cos(theta) - 1), from Eberly's "A Fast and
+// Accurate Algorithm for Computing SLERP". the last terms are scaled by 1 + mu
+// to soak up the truncation error
+#define SLERP_ONE_PLUS_MU 1.90110745351730037f
+static const float slerp_u[8] = {
+	1.0f / (1 * 3), 1.0f / (2 * 5), 1.0f / (3 * 7), 1.0f / (4 * 9),
+	1.0f / (5 * 11), 1.0f / (6 * 13), 1.0f / (7 * 15), SLERP_ONE_PLUS_MU / (8 * 17)
+};
+static const float slerp_v[8] = {
+	1.0f / 3, 2.0f / 5, 3.0f / 7, 4.0f / 9,
+	5.0f / 11, 6.0f / 13, 7.0f / 15, SLERP_ONE_PLUS_MU * 8 / 17
+};
+
+// one element of slerp_batch, also used for the leftovers after the SSE loop.
+// like slerp() we take the short way round by flipping q when the dot is < 0
+static void slerp_one(const versor& q, const versor& r, float t, versor& out) {
+	float x = dot(q, r);
+	float sign = 1.0f;
+	if (x < 0.0f) {
+		x = -x;
+		sign = -1.0f;
+	}
+	float xm1 = x - 1.0f;
+	float d = 1.0f - t;
+	float c_t = 1.0f;
+	float c_d = 1.0f;
+	for (int i = 7; i >= 0; i--) {
+		c_t = 1.0f + (slerp_u[i] * t * t - slerp_v[i]) * xm1 * c_t;
+		c_d = 1.0f + (slerp_u[i] * d * d - slerp_v[i]) * xm1 * c_d;
+	}
+	c_t *= t;
+	c_d *= d * sign;
+	for (int i = 0; i < 4; i++) {
+		out.q[i] = q.q[i] * c_d + r.q[i] * c_t;
+	}
+}
+
+static void nlerp_one(const versor& q, const versor& r, float t, versor& out) {
+	float a = (dot(q, r) < 0.0f) ? t - 1.0f : 1.0f - t;
+	versor result;
+	for (int i = 0; i < 4; i++) {
+		result.q[i] = q.q[i] * a + r.q[i] * t;
+	}
+	float mag = sqrt(dot(result, result));
+	for (int i = 0; i < 4; i++) {
+		out.q[i] = result.q[i] / mag;
+	}
+}
+
+// the 3x3 rotation of quat_to_mat4(), as rows
+static void quat_rows(const versor& q, float* e) {
+	float w = q.q[0];
+	float x = q.q[1];
+	float y = q.q[2];
+	float z = q.q[3];
+	e[0] = 1.0f - 2.0f * y * y - 2.0f * z * z;
+	e[1] = 2.0f * x * y - 2.0f * w * z;
+	e[2] = 2.0f * x * z + 2.0f * w * y;
+	e[3] = 2.0f * x * y + 2.0f * w * z;
+	e[4] = 1.0f - 2.0f * x * x - 2.0f * z * z;
+	e[5] = 2.0f * y * z - 2.0f * w * x;
+	e[6] = 2.0f * x * z - 2.0f * w * y;
+	e[7] = 2.0f * y * z + 2.0f * w * x;
+	e[8] = 1.0f - 2.0f * x * x - 2.0f * y * y;
+}
+
+#ifdef MATHS_SSE
+// 4 versors in, one register each of w x y z out (and back again)
+static inline void load_quats(const versor* q, __m128& w, __m128& x, __m128& y, __m128& z) {
+	w = _mm_loadu_ps(q[0].q);
+	x = _mm_loadu_ps(q[1].q);
+	y = _mm_loadu_ps(q[2].q);
+	z = _mm_loadu_ps(q[3].q);
+	_MM_TRANSPOSE4_PS(w, x, y, z);
+}
+
+static inline void store_quats(versor* q, __m128 w, __m128 x, __m128 y, __m128 z) {
+	_MM_TRANSPOSE4_PS(w, x, y, z);
+	_mm_storeu_ps(q[0].q, w);
+	_mm_storeu_ps(q[1].q, x);
+	_mm_storeu_ps(q[2].q, y);
+	_mm_storeu_ps(q[3].q, z);
+}
+
+// the 9 rotation terms for 4 quaternions at once, e[row * 3 + col]
+static inline void quat_rows_ps(const versor* q, __m128* e) {
+	__m128 w, x, y, z;
+	load_quats(q, w, x, y, z);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 x2 = _mm_add_ps(x, x);
+	__m128 y2 = _mm_add_ps(y, y);
+	__m128 z2 = _mm_add_ps(z, z);
+	__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+	__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+	__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+	e[0] = _mm_sub_ps(_mm_sub_ps(one, yy), zz);
+	e[1] = _mm_sub_ps(xy, wz);
+	e[2] = _mm_add_ps(xz, wy);
+	e[3] = _mm_add_ps(xy, wz);
+	e[4] = _mm_sub_ps(_mm_sub_ps(one, xx), zz);
+	e[5] = _mm_sub_ps(yz, wx);
+	e[6] = _mm_sub_ps(xz, wy);
+	e[7] = _mm_add_ps(yz, wx);
+	e[8] = _mm_sub_ps(_mm_sub_ps(one, xx), yy);
+}
+#endif
+
+void slerp_batch(const versor* q, const versor* r, const float* t, versor* out, int count) {
+	int i = 0;
+#ifdef MATHS_SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign_bit = _mm_set1_ps(-0.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 qw, qx, qy, qz, rw, rx, ry, rz;
+		load_quats(q + i, qw, qx, qy, qz);
+		load_quats(r + i, rw, rx, ry, rz);
+		__m128 tt = _mm_loadu_ps(t + i);
+		__m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, rw), _mm_mul_ps(qx, rx)),
+			_mm_add_ps(_mm_mul_ps(qy, ry), _mm_mul_ps(qz, rz)));
+		// take the sign off a negative dot product, it gets put back on the q
+		// weight. -0.0 isn't < 0 so it's left alone, same as slerp_one
+		__m128 sign = _mm_and_ps(_mm_cmplt_ps(x, _mm_setzero_ps()), sign_bit);
+		x = _mm_xor_ps(x, sign);
+		__m128 xm1 = _mm_sub_ps(x, one);
+		__m128 d = _mm_sub_ps(one, tt);
+		__m128 sqr_t = _mm_mul_ps(tt, tt);
+		__m128 sqr_d = _mm_mul_ps(d, d);
+		__m128 c_t = one;
+		__m128 c_d = one;
+		for (int k = 7; k >= 0; k--) {
+			__m128 u = _mm_set1_ps(slerp_u[k]);
+			__m128 v = _mm_set1_ps(slerp_v[k]);
+			__m128 b_t = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqr_t), v), xm1);
+			__m128 b_d = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqr_d), v), xm1);
+			c_t = _mm_add_ps(one, _mm_mul_ps(b_t, c_t));
+			c_d = _mm_add_ps(one, _mm_mul_ps(b_d, c_d));
+		}
+		c_t = _mm_mul_ps(c_t, tt);
+		c_d = _mm_xor_ps(_mm_mul_ps(c_d, d), sign);
+		store_quats(out + i,
+			_mm_add_ps(_mm_mul_ps(qw, c_d), _mm_mul_ps(rw, c_t)),
+			_mm_add_ps(_mm_mul_ps(qx, c_d), _mm_mul_ps(rx, c_t)),
+			_mm_add_ps(_mm_mul_ps(qy, c_d), _mm_mul_ps(ry, c_t)),
+			_mm_add_ps(_mm_mul_ps(qz, c_d), _mm_mul_ps(rz, c_t)));
+	}
+#endif
+	for (; i < count; i++) {
+		slerp_one(q[i], r[i], t[i], out[i]);
+	}
+}
+
+void nlerp_batch(const versor* q, const versor* r, const float* t, versor* out, int count) {
+	int i = 0;
+#ifdef MATHS_SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 three = _mm_set1_ps(3.0f);
+	const __m128 sign_bit = _mm_set1_ps(-0.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 qw, qx, qy, qz, rw, rx, ry, rz;
+		load_quats(q + i, qw, qx, qy, qz);
+		load_quats(r + i, rw, rx, ry, rz);
+		__m128 tt = _mm_loadu_ps(t + i);
+		__m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, rw), _mm_mul_ps(qx, rx)),
+			_mm_add_ps(_mm_mul_ps(qy, ry), _mm_mul_ps(qz, rz)));
+		__m128 a = _mm_xor_ps(_mm_sub_ps(one, tt), _mm_and_ps(_mm_cmplt_ps(x, _mm_setzero_ps()), sign_bit));
+		__m128 w = _mm_add_ps(_mm_mul_ps(qw, a), _mm_mul_ps(rw, tt));
+		__m128 vx = _mm_add_ps(_mm_mul_ps(qx, a), _mm_mul_ps(rx, tt));
+		__m128 vy = _mm_add_ps(_mm_mul_ps(qy, a), _mm_mul_ps(ry, tt));
+		__m128 vz = _mm_add_ps(_mm_mul_ps(qz, a), _mm_mul_ps(rz, tt));
+		// rsqrt estimate plus one Newton step: y = y * (3 - m * y * y) / 2
+		__m128 m = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w, w), _mm_mul_ps(vx, vx)),
+			_mm_add_ps(_mm_mul_ps(vy, vy), _mm_mul_ps(vz, vz)));
+		__m128 y = _mm_rsqrt_ps(m);
+		y = _mm_mul_ps(_mm_mul_ps(half, y), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(m, y), y)));
+		store_quats(out + i, _mm_mul_ps(w, y), _mm_mul_ps(vx, y), _mm_mul_ps(vy, y), _mm_mul_ps(vz, y));
+	}
+#endif
+	for (; i < count; i++) {
+		nlerp_one(q[i], r[i], t[i], out[i]);
+	}
+}
+
+void normalise_batch(const versor* in, versor* out, int count) {
+	int i = 0;
+#ifdef MATHS_SSE
+	for (; i + 4 <= count; i += 4) {
+		__m128 w, x, y, z;
+		load_quats(in + i, w, x, y, z);
+		__m128 mag = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(w, w), _mm_mul_ps(x, x)),
+			_mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z))));
+		store_quats(out + i, _mm_div_ps(w, mag), _mm_div_ps(x, mag), _mm_div_ps(y, mag), _mm_div_ps(z, mag));
+	}
+#endif
+	for (; i < count; i++) {
+		float mag = sqrt(dot(in[i], in[i]));
+		for (int k = 0; k < 4; k++) {
+			out[i].q[k] = in[i].q[k] / mag;
+		}
+	}
+}
+
+void quat_to_mat4_batch(const versor* q, mat4* out, int count) {
+	int i = 0;
+#ifdef MATHS_SSE
+	const __m128 w_col = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 e[9];
+		quat_rows_ps(q + i, e);
+		// e[col], e[3 + col], e[6 + col] across the 4 quats transpose into
+		// column col of each of the 4 matrices
+		for (int col = 0; col < 3; col++) {
+			__m128 c0 = e[col], c1 = e[3 + col], c2 = e[6 + col], c3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			_mm_storeu_ps(&out[i].m[col * 4], c0);
+			_mm_storeu_ps(&out[i + 1].m[col * 4], c1);
+			_mm_storeu_ps(&out[i + 2].m[col * 4], c2);
+			_mm_storeu_ps(&out[i + 3].m[col * 4], c3);
+		}
+		for (int k = 0; k < 4; k++) {
+			_mm_storeu_ps(&out[i + k].m[12], w_col);
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		out[i] = quat_to_mat4(q[i]);
+	}
+}
+
+void quat_to_affine_batch(const versor* q, affine* out, int count) {
+	int i = 0;
+#ifdef MATHS_SSE
+	for (; i + 4 <= count; i += 4) {
+		__m128 e[9];
+		quat_rows_ps(q + i, e);
+		// affine is stored in rows, with a zero translation
+		for (int row = 0; row < 3; row++) {
+			__m128 c0 = e[row * 3], c1 = e[row * 3 + 1], c2 = e[row * 3 + 2], c3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			_mm_storeu_ps(&out[i].m[row * 4], c0);
+			_mm_storeu_ps(&out[i + 1].m[row * 4], c1);
+			_mm_storeu_ps(&out[i + 2].m[row * 4], c2);
+			_mm_storeu_ps(&out[i + 3].m[row * 4], c3);
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		float e[9];
+		quat_rows(q[i], e);
+		for (int row = 0; row < 3; row++) {
+			out[i].m[row * 4] = e[row * 3];
+			out[i].m[row * 4 + 1] = e[row * 3 + 1];
+			out[i].m[row * 4 + 2] = e[row * 3 + 2];
+			out[i].m[row * 4 + 3] = 0.0f;
+		}
+	}
+}
+
+/*-------------------------------------BENCHMARKS-------------------------------------*/
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static float max_difference(const mat4& a, const mat4& b) {
+	float worst = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		worst = fmaxf(worst, fabsf(a.m[i] - b.m[i]));
+	}
+	return worst;
+}
+
+static void print_timing(const char* name, int iterations, double before, double after, float difference) {
+	printf("  %s x%i: scalar %.1f ms, simd %.1f ms, %.1fx, max difference %g\n",
+		name, iterations, before, after, after > 0.0 ? before / after : 0.0, difference);
+}
+
+// the "before" side of the benchmarks stands in for functions that used to
+// live in this file, where callers in other files could never inline them
+#if defined(_MSC_VER)
+#define OUT_OF_LINE __declspec(noinline)
+#else
+#define OUT_OF_LINE __attribute__((noinline))
+#endif
+
+// mat4*mat4 as it was before the SIMD paths, zeroing the result first
+static OUT_OF_LINE mat4 multiply_scalar(const mat4& a, const mat4& b) {
+	mat4 r = zero_mat4();
+	int r_index = 0;
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+			for (int i = 0; i < 4; i++) {
+				sum += b.m[i + col * 4] * a.m[row + i * 4];
+			}
+			r.m[r_index] = sum;
+			r_index++;
+		}
+	}
+	return r;
+}
+
+void mat4_benchmark(int iterations) {
+	// each step feeds the last one's result back in, so the loops time the
+	// latency of one call rather than how many can be in flight. a rotation
+	// keeps the products from blowing up, and inverting twice comes back round
+	mat4 step = rotate_y_deg(rotate_x_deg(identity_mat4(), 0.5f), 0.25f);
+	mat4 start = translate(scale(rotate_z_deg(identity_mat4(), 30.0f), vec3(2.0f, 3.0f, 0.5f)), vec3(1.0f, -2.0f, 5.0f));
+#if defined(MATHS_AVX)
+	printf("mat4 benchmark (avx)\n");
+#elif defined(MATHS_SSE)
+	printf("mat4 benchmark (sse)\n");
+#else
+	printf("mat4 benchmark (no simd, so both sides run the same code)\n");
+#endif
+
+	mat4 a = start, b = start;
+	std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		a = multiply_scalar(a, step);
+	}
+	double before = ms_since(t);
+	t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		b = b * step;
+	}
+	print_timing("mat4 * mat4", iterations, before, ms_since(t), max_difference(a, b));
+
+	a = b = start;
+	t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		a = inverse_scalar(a);
+	}
+	before = ms_since(t);
+	t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		b = inverse(b);
+	}
+	print_timing("inverse", iterations, before, ms_since(t), max_difference(a, b));
+
+	a = b = start;
+	t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		a = transpose_scalar(a);
+	}
+	before = ms_since(t);
+	t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		b = transpose(b);
+	}
+	print_timing("transpose", iterations, before, ms_since(t), max_difference(a, b));
+}
+
+// the small functions as they were before they moved into the header: out of
+// line, and building a whole matrix to multiply by for each transform
+static OUT_OF_LINE vec3 old_add(const vec3& a, const vec3& b) {
+	return vec3(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2]);
+}
+
+static OUT_OF_LINE vec3 old_mul(const vec3& a, float s) {
+	return vec3(a.v[0] * s, a.v[1] * s, a.v[2] * s);
+}
+
+static OUT_OF_LINE vec3 old_cross(const vec3& a, const vec3& b) {
+	float x = a.v[1] * b.v[2] - a.v[2] * b.v[1];
+	float y = a.v[2] * b.v[0] - a.v[0] * b.v[2];
+	float z = a.v[0] * b.v[1] - a.v[1] * b.v[0];
+	return vec3(x, y, z);
+}
+
+static OUT_OF_LINE vec3 old_normalise(const vec3& v) {
+	float l = sqrt(v.v[0] * v.v[0] + v.v[1] * v.v[1] + v.v[2] * v.v[2]);
+	if (0.0f == l) {
+		return vec3(0.0f, 0.0f, 0.0f);
+	}
+	return vec3(v.v[0] / l, v.v[1] / l, v.v[2] / l);
+}
+
+static OUT_OF_LINE mat4 old_translate(const mat4& m, const vec3& v) {
+	mat4 m_t = identity_mat4();
+	m_t.m[12] = v.v[0];
+	m_t.m[13] = v.v[1];
+	m_t.m[14] = v.v[2];
+	return multiply_scalar(m_t, m);
+}
+
+static OUT_OF_LINE mat4 old_rotate_z_deg(const mat4& m, float deg) {
+	float rad = deg * ONE_DEG_IN_RAD;
+	mat4 m_r = identity_mat4();
+	m_r.m[0] = cos(rad);
+	m_r.m[4] = -sin(rad);
+	m_r.m[1] = sin(rad);
+	m_r.m[5] = cos(rad);
+	return multiply_scalar(m_r, m);
+}
+
+static OUT_OF_LINE mat4 old_scale(const mat4& m, const vec3& v) {
+	mat4 a = identity_mat4();
+	a.m[0] = v.v[0];
+	a.m[5] = v.v[1];
+	a.m[10] = v.v[2];
+	return multiply_scalar(a, m);
+}
+
+void inline_benchmark(int iterations) {
+	// the arm's model matrix from display(), with the angle changing every time
+	// round so nothing can be folded away, and keypress()'s strafe sideways
+	// from the origin, which walks the eye round in a circle
+	printf("inlining benchmark\n");
+	const vec3 up(0.0f, 1.0f, 0.0f);
+	mat4 model_a = identity_mat4(), model_b = identity_mat4();
+	vec3 pos_a(0.0f, 0.0f, -10.0f), pos_b = pos_a;
+	std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		mat4 m = old_rotate_z_deg(identity_mat4(), 180.0f);
+		m = old_rotate_z_deg(m, i * 0.01f);
+		m = old_translate(m, vec3(0.0f, 7.0f, -0.15f));
+		model_a = old_scale(m, vec3(0.3f, 0.3f, 0.3f));
+		pos_a = old_add(pos_a, old_mul(old_normalise(old_cross(pos_a, up)), 0.01f));
+	}
+	double before = ms_since(t);
+	t = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		mat4 m = rotate_z_deg(identity_mat4(), 180.0f);
+		m = rotate_z_deg(m, i * 0.01f);
+		m = translate(m, vec3(0.0f, 7.0f, -0.15f));
+		model_b = scale(m, vec3(0.3f, 0.3f, 0.3f));
+		pos_b = pos_b + normalise(cross(pos_b, up)) * 0.01f;
+	}
+	double after = ms_since(t);
+	float difference = fmaxf(max_difference(model_a, model_b), length(pos_a - pos_b));
+	printf("  model matrix + strafe x%i: out of line %.1f ms, inline %.1f ms, %.1fx, max difference %g\n",
+		iterations, before, after, after > 0.0 ? before / after : 0.0, difference);
+}
+
+/*---------------------------------------CHECKS---------------------------------------*/
+
+// 0 to 1, the same sequence every run
+static float check_random(unsigned int& state) {
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float max_difference(const versor& a, const versor& b) {
+	float worst = 0.0f;
+	for (int i = 0; i < 4; i++) {
+		worst = fmaxf(worst, fabsf(a.q[i] - b.q[i]));
+	}
+	return worst;
+}
+
+static float max_difference(const affine& a, const affine& b) {
+	float worst = 0.0f;
+	for (int i = 0; i < 12; i++) {
+		worst = fmaxf(worst, fabsf(a.m[i] - b.m[i]));
+	}
+	return worst;
+}
+
+void quat_batch_check(int count) {
+	if (count < 8) {
+		count = 8;
+	}
+	std::vector<versor> q(count), r(count), out(count);
+	std::vector<float> t(count);
+	unsigned int seed = 1;
+	for (int i = 0; i < count; i++) {
+		vec3 axis = normalise(vec3(check_random(seed) - 0.5f, check_random(seed) - 0.5f, check_random(seed) + 0.1f));
+		q[i] = quat_from_axis_deg(check_random(seed) * 720.0f - 360.0f, axis.v[0], axis.v[1], axis.v[2]);
+		r[i] = quat_from_axis_deg(check_random(seed) * 720.0f - 360.0f, axis.v[1], axis.v[2], axis.v[0]);
+		t[i] = check_random(seed);
+	}
+	// a pair whose dot comes out as -0.0, once in the SIMD loop and once in the
+	// scalar tail, so both have to pick the same hemisphere as slerp()
+	const float s = 0.57735027f;
+	versor zq, zr;
+	zq.q[0] = 1.0f; zq.q[1] = -0.0f; zq.q[2] = -0.0f; zq.q[3] = -0.0f;
+	zr.q[0] = -0.0f; zr.q[1] = s; zr.q[2] = s; zr.q[3] = s;
+	q[0] = q[count - 1] = zq;
+	r[0] = r[count - 1] = zr;
+	printf("quaternion batch check, %i quaternions\n", count);
+
+	float worst = 0.0f;
+	slerp_batch(q.data(), r.data(), t.data(), out.data(), count);
+	for (int i = 0; i < count; i++) {
+		versor qc = q[i], rc = r[i];
+		worst = fmaxf(worst, max_difference(out[i], slerp(qc, rc, t[i])));
+	}
+	printf("  slerp_batch against slerp: max error %g\n", worst);
+
+	worst = 0.0f;
+	nlerp_batch(q.data(), r.data(), t.data(), out.data(), count);
+	for (int i = 0; i < count; i++) {
+		// the same lerp and renormalise in double
+		double a = (dot(q[i], r[i]) < 0.0f) ? t[i] - 1.0 : 1.0 - t[i];
+		double v[4], mag = 0.0;
+		for (int k = 0; k < 4; k++) {
+			v[k] = q[i].q[k] * a + r[i].q[k] * (double)t[i];
+			mag += v[k] * v[k];
+		}
+		for (int k = 0; k < 4; k++) {
+			worst = fmaxf(worst, (float)fabs(out[i].q[k] - v[k] / sqrt(mag)));
+		}
+	}
+	printf("  nlerp_batch against a double precision nlerp: max error %g\n", worst);
+
+	worst = 0.0f;
+	std::vector<versor> scaled(count);
+	for (int i = 0; i < count; i++) {
+		scaled[i] = q[i] * (0.5f + 2.0f * t[i]);
+	}
+	normalise_batch(scaled.data(), out.data(), count);
+	for (int i = 0; i < count; i++) {
+		// not against normalise(versor), which leaves anything near enough unit
+		// length alone
+		double mag = 0.0;
+		for (int k = 0; k < 4; k++) {
+			mag += (double)scaled[i].q[k] * scaled[i].q[k];
+		}
+		for (int k = 0; k < 4; k++) {
+			worst = fmaxf(worst, (float)fabs(out[i].q[k] - scaled[i].q[k] / sqrt(mag)));
+		}
+	}
+	printf("  normalise_batch against a double precision normalise: max error %g\n", worst);
+
+	worst = 0.0f;
+	std::vector<mat4> mats(count);
+	quat_to_mat4_batch(q.data(), mats.data(), count);
+	for (int i = 0; i < count; i++) {
+		worst = fmaxf(worst, max_difference(mats[i], quat_to_mat4(q[i])));
+	}
+	printf("  quat_to_mat4_batch against quat_to_mat4: max error %g\n", worst);
+
+	worst = 0.0f;
+	std::vector<affine> affines(count);
+	quat_to_affine_batch(q.data(), affines.data(), count);
+	for (int i = 0; i < count; i++) {
+		worst = fmaxf(worst, max_difference(affines[i], affine(quat_to_mat4(q[i]))));
+	}
+	printf("  quat_to_affine_batch against quat_to_mat4: max error %g\n", worst);
+}
+
+// error of one normalised vector against the exact answer, worked out in double
+static float normalise_error(const vec3& in, const vec3& out) {
+	double len = sqrt((double)in.v[0] * in.v[0] + (double)in.v[1] * in.v[1] + (double)in.v[2] * in.v[2]);
+	double worst = 0.0;
+	for (int k = 0; k < 3; k++) {
+		double exact = (len > 0.0) ? in.v[k] / len : 0.0;
+		worst = fmax(worst, fabs(out.v[k] - exact));
+	}
+	return (float)worst;
+}
+
+void normalise_check(int count) {
+	if (count < 8) {
+		count = 8;
+	}
+	// directions scaled anywhere from 1e-22 to 1e18, so some squared lengths are
+	// denormal, and a few zero vectors
+	std::vector<vec3> in(count), fast(count), precise(count);
+	unsigned int seed = 2;
+	for (int i = 0; i < count; i++) {
+		vec3 d(check_random(seed) - 0.5f, check_random(seed) - 0.5f, check_random(seed) - 0.5f);
+		float l = length(d);
+		float m = powf(10.0f, check_random(seed) * 40.0f - 22.0f);
+		in[i] = (l > 0.0f && i % 97 != 0) ? d * (m / l) : vec3(0.0f, 0.0f, 0.0f);
+	}
+	normalise_vec3s(in.data(), fast.data(), count, NORMALISE_FAST);
+	normalise_vec3s(in.data(), precise.data(), count, NORMALISE_PRECISE);
+	float fast_error = 0.0f, precise_error = 0.0f, tiny_fast = 0.0f, tiny_precise = 0.0f, against_scalar = 0.0f;
+	int tiny = 0, not_finite = 0;
+	for (int i = 0; i < count; i++) {
+		for (int k = 0; k < 3; k++) {
+			if (!isfinite(fast[i].v[k]) || !isfinite(precise[i].v[k])) {
+				not_finite++;
+			}
+		}
+		vec3 scalar = normalise(in[i]);
+		against_scalar = fmaxf(against_scalar, length(precise[i] - scalar));
+		if (length2(in[i]) < FLT_MIN) {
+			tiny += length2(in[i]) > 0.0f;
+			tiny_fast = fmaxf(tiny_fast, normalise_error(in[i], fast[i]));
+			tiny_precise = fmaxf(tiny_precise, normalise_error(in[i], precise[i]));
+		} else {
+			fast_error = fmaxf(fast_error, normalise_error(in[i], fast[i]));
+			precise_error = fmaxf(precise_error, normalise_error(in[i], precise[i]));
+		}
+	}
+	printf("normalise_vec3s check, %i vectors\n", count);
+	printf("  fast: max error %g (%.1f ulp of 1)\n", fast_error, fast_error / FLT_EPSILON);
+	printf("  precise: max error %g (%.1f ulp of 1), max difference from normalise(vec3) %g\n",
+		precise_error, precise_error / FLT_EPSILON, against_scalar);
+	printf("  %i with a squared length under FLT_MIN: max error fast %g, precise %g\n", tiny, tiny_fast, tiny_precise);
+	printf("  %i components not finite\n", not_finite);
+}
@@ -1,60 +1,85 @@
 #ifndef _MATHS_FUNCS_H_
 #define _MATHS_FUNCS_H_
 
+#include <math.h>
+#include <stddef.h>
+
+// not every math.h gives us M_PI without _USE_MATH_DEFINES, and main.cpp pulls
+// math.h in before we get here
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 // const used to convert degrees into radians
 #define TWO_PI 2.0 * M_PI
 #define ONE_DEG_IN_RAD (2.0 * M_PI) / 360.0 // 0.017444444
 #define ONE_RAD_IN_DEG 57.2957795
 
+// SIMD backend, picked at build time. SSE is on for any x64 build (and x86 with
+// /arch:SSE2), AVX is added when the compiler is told it may use it (/arch:AVX2
+// or -mavx2). Define MATHS_NO_SIMD to force the plain scalar code.
+#if !defined(MATHS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATHS_SSE 1
+#if defined(__AVX__)
+#define MATHS_AVX 1
+#endif
+#endif
+
+#ifdef MATHS_SSE
+#include <immintrin.h>
+#endif
+
 struct vec2;
 struct vec3;
 struct vec4;
 struct versor;
 
+// the small functions below are defined at the bottom of this file so that
+// they inline into callers, and anything without a sqrt/sin/cos or SIMD in it
+// is constexpr. the default constructors still leave the data uninitialised
+
 struct vec2 {
-	vec2();
-	vec2(float x, float y);
+	vec2() {}
+	constexpr vec2(float x, float y);
 	float v[2];
 };
 
 struct vec3 {
-	vec3();
+	vec3() {}
 	//! create from 3 scalars
-	vec3(float x, float y, float z);
+	constexpr vec3(float x, float y, float z);
 	//! create from vec2 and a scalar
-	vec3(const vec2& vv, float z);
+	constexpr vec3(const vec2& vv, float z);
 	//! create from truncated vec4
-	vec3(const vec4& vv);
+	constexpr vec3(const vec4& vv);
 	//! add vector to vector
-	vec3 operator+ (const vec3& rhs);
+	constexpr vec3 operator+ (const vec3& rhs) const;
 	//! add scalar to vector
-	vec3 operator+ (float rhs);
+	constexpr vec3 operator+ (float rhs) const;
 	//! because user's expect this too
-	vec3& operator+= (const vec3& rhs);
+	constexpr vec3& operator+= (const vec3& rhs);
 	//! subtract vector from vector
-	vec3 operator- (const vec3& rhs);
+	constexpr vec3 operator- (const vec3& rhs) const;
 	//! add vector to vector
-	vec3 operator- (float rhs);
+	constexpr vec3 operator- (float rhs) const;
 	//! because users expect this too
-	vec3& operator-= (const vec3& rhs);
+	constexpr vec3& operator-= (const vec3& rhs);
 	//! multiply with scalar
-	vec3 operator* (float rhs);
+	constexpr vec3 operator* (float rhs) const;
 	//! because users expect this too
-	vec3& operator*= (float rhs);
+	constexpr vec3& operator*= (float rhs);
 	//! divide vector by scalar
-	vec3 operator/ (float rhs);
-	//! because users expect this too
-	vec3& operator= (const vec3& rhs);
+	constexpr vec3 operator/ (float rhs) const;
 
 	//! internal data
 	float v[3];
 };
 
 struct vec4 {
-	vec4();
-	vec4(float x, float y, float z, float w);
-	vec4(const vec2& vv, float z, float w);
-	vec4(const vec3& vv, float w);
+	vec4() {}
+	constexpr vec4(float x, float y, float z, float w);
+	constexpr vec4(const vec2& vv, float z, float w);
+	constexpr vec4(const vec3& vv, float w);
 	float v[4];
 };
 
@@ -63,8 +88,8 @@ struct vec4 {
 1 4 7
 2 5 8 */
 struct mat3 {
-	mat3();
-	mat3(float a, float b, float c,
+	mat3() {}
+	constexpr mat3(float a, float b, float c,
 		float d, float e, float f,
 		float g, float h, float i);
 	float m[9];
@@ -76,17 +101,54 @@ struct mat3 {
 2 6 10 14
 3 7 11 15*/
 struct mat4 {
-	mat4();
-	mat4(float a, float b, float c, float d,
+	mat4() {}
+	constexpr mat4(float a, float b, float c, float d,
 		float e, float f, float g, float h,
 		float i, float j, float k, float l,
 		float mm, float n, float o, float p);
-	vec4 operator* (const vec4& rhs);
-	mat4 operator* (const mat4& rhs);
-	mat4& operator= (const mat4& rhs);
+	inline vec4 operator* (const vec4& rhs) const;
+	inline mat4 operator* (const mat4& rhs) const;
 	float m[16];
 };
 
+/* affine transform, ie. the top three rows of a mat4 whose bottom row is
+0 0 0 1. unlike mat4 this is stored in rows, so that each row is one SIMD
+register and the translation is the last column:
+0 1 2  3
+4 5 6  7
+8 9 10 11 */
+struct affine {
+	affine() {}
+	//! take the top three rows of a mat4 (the bottom row is assumed to be 0 0 0 1)
+	constexpr affine(const mat4& mm);
+	//! this * rhs, ie. rhs is applied first, same as mat4
+	inline affine operator* (const affine& rhs) const;
+	float m[12];
+};
+
+/* axis-aligned bounding box, from its lowest corner to its highest. mn/mx
+rather than min/max so windows.h's macros leave it alone */
+struct aabb {
+	aabb() {}
+	constexpr aabb(const vec3& lo, const vec3& hi);
+	vec3 mn;
+	vec3 mx;
+};
+
+struct sphere {
+	sphere() {}
+	constexpr sphere(const vec3& c, float r);
+	vec3 centre;
+	float radius;
+};
+
+/* the six planes of a view volume as (a, b, c, d), with a*x + b*y + c*z + d >= 0
+on the inside. the normals are unit length, so d is a distance.
+order: left, right, bottom, top, near, far */
+struct frustum {
+	vec4 planes[6];
+};
+
 struct versor {
 	versor();
 	versor operator/ (float rhs);
@@ -96,38 +158,155 @@ struct versor {
 	float q[4];
 };
 
-float radians(float x);
+/* GPU buffer storage. GLSL's std140 and std430 layouts put every vec3, vec4 and
+mat4 on a 16 byte boundary, and an array of vec3s has a 16 byte stride. these
+are the plain types with that alignment (and vec3 padded out to 16 bytes), so
+an array of them can be memcpy'd straight into a mapped uniform or storage
+buffer. they convert to and from the plain types, and can be passed anywhere
+a const vec3&, vec4& or mat4& is wanted. std::vector only honours the
+alignment from C++17 on, but malloc on 64-bit targets gives 16 anyway */
+struct alignas(16) vec3a : public vec3 {
+	vec3a() {}
+	constexpr vec3a(const vec3& vv);
+	constexpr vec3a(float x, float y, float z);
+	float pad; // the unused 4th float, zeroed by the constructors
+};
+
+struct alignas(16) vec4a : public vec4 {
+	vec4a() {}
+	constexpr vec4a(const vec4& vv);
+	constexpr vec4a(float x, float y, float z, float w);
+};
+
+struct alignas(16) mat4a : public mat4 {
+	mat4a() {}
+	constexpr mat4a(const mat4& mm);
+};
+
+/* a mat3 the way GLSL lays it out in a buffer: three columns, each padded
+out to a vec4
+0 3 6
+1 4 7
+2 5 8
+- - - */
+struct alignas(16) mat3a {
+	mat3a() {}
+	constexpr mat3a(const mat3& mm);
+	constexpr mat3 to_mat3() const;
+	float m[12];
+};
+
+static_assert(sizeof(vec3a) == 16 && alignof(vec3a) == 16, "vec3a must match a GLSL vec3 array element");
+static_assert(sizeof(vec4a) == 16 && alignof(vec4a) == 16, "vec4a must match a GLSL vec4");
+static_assert(sizeof(mat4a) == 64 && alignof(mat4a) == 16, "mat4a must match a GLSL mat4");
+static_assert(sizeof(mat3a) == 48 && alignof(mat3a) == 16, "mat3a must match a GLSL mat3");
+
+constexpr float radians(float x);
 void print(const vec2& v);
 void print(const vec3& v);
 void print(const vec4& v);
 void print(const mat3& m);
 void print(const mat4& m);
 // vector functions
-float length(const vec3& v);
-float length2(const vec3& v);
-vec3 normalise(const vec3& v);
-float dot(const vec3& a, const vec3& b);
-vec3 cross(const vec3& a, const vec3& b);
-float get_squared_dist(vec3 from, vec3 to);
-float direction_to_heading(vec3 d);
-vec3 heading_to_direction(float degrees);
+inline float length(const vec3& v);
+constexpr float length2(const vec3& v);
+inline vec3 normalise(const vec3& v);
+constexpr float dot(const vec3& a, const vec3& b);
+constexpr vec3 cross(const vec3& a, const vec3& b);
+constexpr float get_squared_dist(vec3 from, vec3 to);
+inline float direction_to_heading(vec3 d);
+inline vec3 heading_to_direction(float degrees);
 // matrix functions
-mat3 zero_mat3();
-mat3 identity_mat3();
-mat4 zero_mat4();
-mat4 identity_mat4();
+constexpr mat3 zero_mat3();
+constexpr mat3 identity_mat3();
+constexpr mat4 zero_mat4();
+constexpr mat4 identity_mat4();
 float determinant(const mat4& mm);
 mat4 inverse(const mat4& mm);
 mat4 transpose(const mat4& mm);
 // affine functions
-mat4 translate(const mat4& m, const vec3& v);
-mat4 rotate_x_deg(const mat4& m, float deg);
-mat4 rotate_y_deg(const mat4& m, float deg);
-mat4 rotate_z_deg(const mat4& m, float deg);
-mat4 scale(const mat4& m, const vec3& v);
+constexpr mat4 translate(const mat4& m, const vec3& v);
+inline mat4 rotate_x_deg(const mat4& m, float deg);
+inline mat4 rotate_y_deg(const mat4& m, float deg);
+inline mat4 rotate_z_deg(const mat4& m, float deg);
+constexpr mat4 scale(const mat4& m, const vec3& v);
+// affine transform functions. these match the mat4 versions above but only
+// carry the 12 floats that can be non-constant
+constexpr affine identity_affine();
+constexpr mat4 to_mat4(const affine& a);
+inline affine translate(const affine& a, const vec3& v);
+inline affine rotate_x_deg(const affine& a, float deg);
+inline affine rotate_y_deg(const affine& a, float deg);
+inline affine rotate_z_deg(const affine& a, float deg);
+inline affine scale(const affine& a, const vec3& v);
+constexpr vec3 transform_point(const affine& a, const vec3& p);
+constexpr vec3 transform_direction(const affine& a, const vec3& d);
+// works for any invertible transform (scales and shears included)
+affine inverse(const affine& a);
+// rotation + translation only: transposes the rotation instead of inverting it
+affine inverse_rigid(const affine& a);
+// inverse transpose of the upper 3x3, for transforming normals
+mat3 normal_matrix(const affine& a);
+// batch functions, for running one matrix over whole vertex arrays. out_stride
+// is the distance in bytes between output elements (0 = tightly packed), so the
+// results can be written straight into an interleaved vertex buffer
+void transform_points(const mat4& m, const vec3* in, vec3* out, int count, int out_stride = 0);
+void transform_directions(const mat4& m, const vec3* in, vec3* out, int count, int out_stride = 0);
+void transform_vec4s(const mat4& m, const vec4* in, vec4* out, int count, int out_stride = 0);
+// as transform_points but split into chunks over num_threads threads (0 = one
+// per core). small arrays are done on the calling thread
+void transform_points_mt(const mat4& m, const vec3* in, vec3* out, int count, int out_stride = 0, int num_threads = 0);
+// normalise a whole array of vectors, eg. mesh normals. in and out may be the
+// same array, and zero vectors stay zero. NORMALISE_FAST uses the SSE rsqrt
+// estimate refined with one Newton step (within 2.5 ulp of exact), except on
+// vectors so short their squared length is denormal. NORMALISE_PRECISE gives
+// the same results as normalise(vec3)
+#define NORMALISE_FAST 0
+#define NORMALISE_PRECISE 1
+void normalise_vec3s(const vec3* in, vec3* out, int count, int mode = NORMALISE_FAST);
+// drop the z of every vector, eg. for the 3D texture coordinates importers
+// hand out. in and out must not overlap
+void vec3s_to_vec2s(const vec3* in, vec2* out, int count);
 // camera functions
 mat4 look_at(const vec3& cam_pos, vec3 targ_pos, const vec3& up);
 mat4 perspective(float fovy, float aspect, float near, float far);
+// bounding volume functions
+#define CULL_OUTSIDE 0
+#define CULL_INTERSECT 1
+#define CULL_INSIDE 2
+// both are zero if count is 0. the sphere is centred on the box so it is a bit
+// bigger than the smallest possible one
+aabb aabb_from_points(const vec3* pts, int count);
+sphere sphere_from_points(const vec3* pts, int count);
+// box around the transformed box
+aabb transform_aabb(const mat4& m, const aabb& b);
+// planes come out in whatever space the matrix maps from, so proj * view gives
+// world space planes and proj * view * model gives them in model space
+frustum extract_frustum(const mat4& m);
+// returns CULL_OUTSIDE, CULL_INTERSECT or CULL_INSIDE
+int classify(const frustum& f, const aabb& b);
+int classify(const frustum& f, const sphere& s);
+// batch versions. result[i] gets the CULL_ value for element i, and the return
+// value is how many were not CULL_OUTSIDE
+int classify_aabbs(const frustum& f, const aabb* boxes, int count, unsigned char* result);
+int classify_spheres(const frustum& f, const sphere* spheres, int count, unsigned char* result);
+// buffer layout helpers, for working out member offsets in a uniform or
+// storage block by hand. std_align rounds offset up to the next multiple of
+// alignment (a power of 2). the strides are for arrays of scalars and vectors:
+// std140 rounds every element up to 16 bytes, std430 only does it for vec3s
+constexpr size_t std_align(size_t offset, size_t alignment);
+constexpr size_t std140_array_stride(size_t elem_size);
+constexpr size_t std430_array_stride(size_t elem_size);
+// vertex packing functions, for squeezing vertex attributes down for the GPU.
+// the half float conversions round to nearest even and keep infinities, NaNs
+// and denormals. oct_encode folds a unit vector onto an octahedron and flattens
+// that into two snorm16s (Cigolle et al. 2014), trying the four nearest codes
+// and keeping the one that decodes closest to n. oct_decode is the inverse,
+// done the same way as in the vertex shader
+unsigned short float_to_half(float f);
+float half_to_float(unsigned short h);
+void oct_encode(const vec3& n, short out[2]);
+vec3 oct_decode(short x, short y);
 // quaternion functions
 versor quat_from_axis_rad(float radians, float x, float y, float z);
 versor quat_from_axis_deg(float degrees, float x, float y, float z);
@@ -138,4 +317,490 @@ versor slerp(const versor& q, const versor& r);
 versor normalise(versor& q);
 void print(const versor& q);
 versor slerp(versor& q, versor& r, float t);
-#endif
\ No newline at end of file
+// batch quaternion functions, 4 at a time with SSE. inputs are left alone, and
+// t is per element so every arm can be at a different point in its animation.
+// slerp_batch uses a polynomial fit of sin(t*theta)/sin(theta) (error < 4e-5)
+// so it needs no acos/sin, nlerp_batch is the cheaper lerp + renormalise
+void slerp_batch(const versor* q, const versor* r, const float* t, versor* out, int count);
+void nlerp_batch(const versor* q, const versor* r, const float* t, versor* out, int count);
+void normalise_batch(const versor* in, versor* out, int count);
+void quat_to_mat4_batch(const versor* q, mat4* out, int count);
+void quat_to_affine_batch(const versor* q, affine* out, int count);
+// benchmarks: run each kernel iterations times in a dependent chain against the
+// scalar code it replaced, and print both times and how far the results drift
+void mat4_benchmark(int iterations);
+// the display() and keypress() maths through the inline functions, against
+// out of line copies of how they were before
+void inline_benchmark(int iterations);
+// checks: run the batch functions over count made up inputs and print the
+// largest difference from the one-at-a-time versions
+void quat_batch_check(int count);
+void normalise_check(int count);
+
+/*-----------------------------------CONSTRUCTORS-------------------------------------*/
+
+constexpr vec2::vec2(float x, float y) : v{ x, y } {}
+
+constexpr vec3::vec3(float x, float y, float z) : v{ x, y, z } {}
+
+constexpr vec3::vec3(const vec2& vv, float z) : v{ vv.v[0], vv.v[1], z } {}
+
+constexpr vec3::vec3(const vec4& vv) : v{ vv.v[0], vv.v[1], vv.v[2] } {}
+
+constexpr vec4::vec4(float x, float y, float z, float w) : v{ x, y, z, w } {}
+
+constexpr vec4::vec4(const vec2& vv, float z, float w) : v{ vv.v[0], vv.v[1], z, w } {}
+
+constexpr vec4::vec4(const vec3& vv, float w) : v{ vv.v[0], vv.v[1], vv.v[2], w } {}
+
+constexpr aabb::aabb(const vec3& lo, const vec3& hi) : mn(lo), mx(hi) {}
+
+constexpr sphere::sphere(const vec3& c, float r) : centre(c), radius(r) {}
+
+// note: entered in rows, but stored in columns
+constexpr mat3::mat3(float a, float b, float c,
+	float d, float e, float f,
+	float g, float h, float i) : m{ a, d, g, b, e, h, c, f, i } {}
+
+// note: entered in rows, but stored in columns
+constexpr mat4::mat4(float a, float b, float c, float d,
+	float e, float f, float g, float h,
+	float i, float j, float k, float l,
+	float mm, float n, float o, float p) : m{ a, e, i, mm, b, f, j, n, c, g, k, o, d, h, l, p } {}
+
+constexpr vec3a::vec3a(const vec3& vv) : vec3(vv), pad(0.0f) {}
+
+constexpr vec3a::vec3a(float x, float y, float z) : vec3(x, y, z), pad(0.0f) {}
+
+constexpr vec4a::vec4a(const vec4& vv) : vec4(vv) {}
+
+constexpr vec4a::vec4a(float x, float y, float z, float w) : vec4(x, y, z, w) {}
+
+constexpr mat4a::mat4a(const mat4& mm) : mat4(mm) {}
+
+constexpr mat3a::mat3a(const mat3& mm) : m{
+	mm.m[0], mm.m[1], mm.m[2], 0.0f,
+	mm.m[3], mm.m[4], mm.m[5], 0.0f,
+	mm.m[6], mm.m[7], mm.m[8], 0.0f } {}
+
+constexpr mat3 mat3a::to_mat3() const {
+	// the mat3 constructor takes rows
+	return mat3(m[0], m[4], m[8],
+		m[1], m[5], m[9],
+		m[2], m[6], m[10]);
+}
+
+constexpr size_t std_align(size_t offset, size_t alignment) {
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+constexpr size_t std140_array_stride(size_t elem_size) {
+	return std_align(elem_size, 16);
+}
+
+constexpr size_t std430_array_stride(size_t elem_size) {
+	return 12 == elem_size ? 16 : elem_size;
+}
+
+constexpr float radians(float x) {
+	return float(x * ONE_DEG_IN_RAD);
+}
+
+/*---------------------------------VECTOR FUNCTIONS-----------------------------------*/
+
+inline float length(const vec3& v) {
+	return sqrt(v.v[0] * v.v[0] + v.v[1] * v.v[1] + v.v[2] * v.v[2]);
+}
+
+constexpr float length2(const vec3& v) {
+	return v.v[0] * v.v[0] + v.v[1] * v.v[1] + v.v[2] * v.v[2];
+}
+
+inline vec3 normalise(const vec3& v) {
+	float l = length(v);
+	if (0.0f == l) {
+		return vec3(0.0f, 0.0f, 0.0f);
+	}
+	return vec3(v.v[0] / l, v.v[1] / l, v.v[2] / l);
+}
+
+constexpr vec3 vec3::operator+ (const vec3& rhs) const {
+	return vec3(v[0] + rhs.v[0], v[1] + rhs.v[1], v[2] + rhs.v[2]);
+}
+
+constexpr vec3& vec3::operator+= (const vec3& rhs) {
+	v[0] += rhs.v[0];
+	v[1] += rhs.v[1];
+	v[2] += rhs.v[2];
+	return *this; // return self
+}
+
+constexpr vec3 vec3::operator- (const vec3& rhs) const {
+	return vec3(v[0] - rhs.v[0], v[1] - rhs.v[1], v[2] - rhs.v[2]);
+}
+
+constexpr vec3& vec3::operator-= (const vec3& rhs) {
+	v[0] -= rhs.v[0];
+	v[1] -= rhs.v[1];
+	v[2] -= rhs.v[2];
+	return *this;
+}
+
+constexpr vec3 vec3::operator+ (float rhs) const {
+	return vec3(v[0] + rhs, v[1] + rhs, v[2] + rhs);
+}
+
+constexpr vec3 vec3::operator- (float rhs) const {
+	return vec3(v[0] - rhs, v[1] - rhs, v[2] - rhs);
+}
+
+constexpr vec3 vec3::operator* (float rhs) const {
+	return vec3(v[0] * rhs, v[1] * rhs, v[2] * rhs);
+}
+
+constexpr vec3 vec3::operator/ (float rhs) const {
+	return vec3(v[0] / rhs, v[1] / rhs, v[2] / rhs);
+}
+
+constexpr vec3& vec3::operator*= (float rhs) {
+	v[0] = v[0] * rhs;
+	v[1] = v[1] * rhs;
+	v[2] = v[2] * rhs;
+	return *this;
+}
+
+constexpr float dot(const vec3& a, const vec3& b) {
+	return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+}
+
+constexpr vec3 cross(const vec3& a, const vec3& b) {
+	return vec3(
+		a.v[1] * b.v[2] - a.v[2] * b.v[1],
+		a.v[2] * b.v[0] - a.v[0] * b.v[2],
+		a.v[0] * b.v[1] - a.v[1] * b.v[0]
+	);
+}
+
+constexpr float get_squared_dist(vec3 from, vec3 to) {
+	return (to.v[0] - from.v[0]) * (to.v[0] - from.v[0]) +
+		(to.v[1] - from.v[1]) * (to.v[1] - from.v[1]) +
+		(to.v[2] - from.v[2]) * (to.v[2] - from.v[2]);
+}
+
+/* converts an un-normalised direction into a heading in degrees
+NB i suspect that the z is backwards here but i've used in in
+several places like this. d'oh!
+*/
+inline float direction_to_heading(vec3 d) {
+	return atan2(-d.v[0], -d.v[2]) * ONE_RAD_IN_DEG;
+}
+
+inline vec3 heading_to_direction(float degrees) {
+	float rad = degrees * ONE_DEG_IN_RAD;
+	return vec3(-sin(rad), 0.0f, -cos(rad));
+}
+
+/*---------------------------------MATRIX FUNCTIONS-----------------------------------*/
+
+constexpr mat3 zero_mat3() {
+	return mat3(
+		0.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f
+	);
+}
+
+constexpr mat3 identity_mat3() {
+	return mat3(
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f
+	);
+}
+
+constexpr mat4 zero_mat4() {
+	return mat4(
+		0.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 0.0f
+	);
+}
+
+constexpr mat4 identity_mat4() {
+	return mat4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	);
+}
+
+/* mat4 array layout
+0 4 8  12
+1 5 9  13
+2 6 10 14
+3 7 11 15
+*/
+
+inline vec4 mat4::operator* (const vec4& rhs) const {
+#ifdef MATHS_SSE
+	// one column per register, summed in the same order as the scalar rows below
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(&m[0]), _mm_set1_ps(rhs.v[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&m[4]), _mm_set1_ps(rhs.v[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&m[8]), _mm_set1_ps(rhs.v[2])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&m[12]), _mm_set1_ps(rhs.v[3])));
+	vec4 result;
+	_mm_storeu_ps(result.v, r);
+	return result;
+#else
+	float x = m[0] * rhs.v[0] + m[4] * rhs.v[1] + m[8] * rhs.v[2] + m[12] * rhs.v[3]; // 0x + 4y + 8z + 12w
+	float y = m[1] * rhs.v[0] + m[5] * rhs.v[1] + m[9] * rhs.v[2] + m[13] * rhs.v[3]; // 1x + 5y + 9z + 13w
+	float z = m[2] * rhs.v[0] + m[6] * rhs.v[1] + m[10] * rhs.v[2] + m[14] * rhs.v[3]; // 2x + 6y + 10z + 14w
+	float w = m[3] * rhs.v[0] + m[7] * rhs.v[1] + m[11] * rhs.v[2] + m[15] * rhs.v[3]; // 3x + 7y + 11z + 15w
+	return vec4(x, y, z, w);
+#endif
+}
+
+// every element of r is written below, so it is not zeroed first. the SIMD paths
+// keep the scalar summation order (starting from 0.0f, so -0.0 comes out as +0.0
+// just like the loop) and use separate mul/add rather than FMA, which keeps the
+// results bit-identical across backends
+inline mat4 mat4::operator* (const mat4& rhs) const {
+	mat4 r;
+#if defined(MATHS_AVX)
+	// each of our columns duplicated into both 128-bit lanes so that two result
+	// columns are built per iteration
+	__m128 c0 = _mm_loadu_ps(&m[0]);
+	__m128 c1 = _mm_loadu_ps(&m[4]);
+	__m128 c2 = _mm_loadu_ps(&m[8]);
+	__m128 c3 = _mm_loadu_ps(&m[12]);
+	__m256 a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c0, 1);
+	__m256 a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c1), c1, 1);
+	__m256 a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c2, 1);
+	__m256 a3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c3), c3, 1);
+	for (int col = 0; col < 4; col += 2) {
+		__m256 b = _mm256_loadu_ps(&rhs.m[col * 4]);
+		__m256 sum = _mm256_setzero_ps();
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(a0, _mm256_shuffle_ps(b, b, 0x00)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(a1, _mm256_shuffle_ps(b, b, 0x55)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(a2, _mm256_shuffle_ps(b, b, 0xAA)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(a3, _mm256_shuffle_ps(b, b, 0xFF)));
+		_mm256_storeu_ps(&r.m[col * 4], sum);
+	}
+#elif defined(MATHS_SSE)
+	__m128 c0 = _mm_loadu_ps(&m[0]);
+	__m128 c1 = _mm_loadu_ps(&m[4]);
+	__m128 c2 = _mm_loadu_ps(&m[8]);
+	__m128 c3 = _mm_loadu_ps(&m[12]);
+	for (int col = 0; col < 4; col++) {
+		const float* b = &rhs.m[col * 4];
+		__m128 sum = _mm_setzero_ps();
+		sum = _mm_add_ps(sum, _mm_mul_ps(c0, _mm_set1_ps(b[0])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(c1, _mm_set1_ps(b[1])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(c2, _mm_set1_ps(b[2])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(c3, _mm_set1_ps(b[3])));
+		_mm_storeu_ps(&r.m[col * 4], sum);
+	}
+#else
+	int r_index = 0;
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+			for (int i = 0; i < 4; i++) {
+				sum += rhs.m[i + col * 4] * m[row + i * 4];
+			}
+			r.m[r_index] = sum;
+			r_index++;
+		}
+	}
+#endif
+	return r;
+}
+
+/*--------------------------------AFFINE TRANSFORM TYPE-------------------------------*/
+
+constexpr affine::affine(const mat4& mm) : m{
+	mm.m[0], mm.m[4], mm.m[8], mm.m[12],
+	mm.m[1], mm.m[5], mm.m[9], mm.m[13],
+	mm.m[2], mm.m[6], mm.m[10], mm.m[14] } {}
+
+constexpr affine identity_affine() {
+	return affine(identity_mat4());
+}
+
+constexpr mat4 to_mat4(const affine& a) {
+	// mat4 is entered in rows, which is exactly how we store it
+	return mat4(
+		a.m[0], a.m[1], a.m[2], a.m[3],
+		a.m[4], a.m[5], a.m[6], a.m[7],
+		a.m[8], a.m[9], a.m[10], a.m[11],
+		0.0f, 0.0f, 0.0f, 1.0f
+	);
+}
+
+// each result row is a combination of rhs's rows, plus our translation
+inline affine affine::operator* (const affine& rhs) const {
+	affine r;
+#ifdef MATHS_SSE
+	__m128 b0 = _mm_loadu_ps(&rhs.m[0]);
+	__m128 b1 = _mm_loadu_ps(&rhs.m[4]);
+	__m128 b2 = _mm_loadu_ps(&rhs.m[8]);
+	for (int row = 0; row < 12; row += 4) {
+		__m128 s = _mm_mul_ps(_mm_set1_ps(m[row]), b0);
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(m[row + 1]), b1));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(m[row + 2]), b2));
+		s = _mm_add_ps(s, _mm_setr_ps(0.0f, 0.0f, 0.0f, m[row + 3]));
+		_mm_storeu_ps(&r.m[row], s);
+	}
+#else
+	for (int row = 0; row < 12; row += 4) {
+		for (int col = 0; col < 4; col++) {
+			r.m[row + col] = m[row] * rhs.m[col] + m[row + 1] * rhs.m[4 + col] + m[row + 2] * rhs.m[8 + col];
+		}
+		r.m[row + 3] += m[row + 3];
+	}
+#endif
+	return r;
+}
+
+// same pre-multiply convention as the mat4 versions: the new transform is
+// applied after a, so these only ever mix whole rows
+inline affine translate(const affine& a, const vec3& v) {
+	affine r = a;
+	r.m[3] += v.v[0];
+	r.m[7] += v.v[1];
+	r.m[11] += v.v[2];
+	return r;
+}
+
+inline affine rotate_x_deg(const affine& a, float deg) {
+	float rad = deg * ONE_DEG_IN_RAD;
+	float c = cos(rad);
+	float s = sin(rad);
+	affine r = a;
+	for (int col = 0; col < 4; col++) {
+		r.m[4 + col] = c * a.m[4 + col] - s * a.m[8 + col];
+		r.m[8 + col] = s * a.m[4 + col] + c * a.m[8 + col];
+	}
+	return r;
+}
+
+inline affine rotate_y_deg(const affine& a, float deg) {
+	float rad = deg * ONE_DEG_IN_RAD;
+	float c = cos(rad);
+	float s = sin(rad);
+	affine r = a;
+	for (int col = 0; col < 4; col++) {
+		r.m[col] = c * a.m[col] + s * a.m[8 + col];
+		r.m[8 + col] = c * a.m[8 + col] - s * a.m[col];
+	}
+	return r;
+}
+
+inline affine rotate_z_deg(const affine& a, float deg) {
+	float rad = deg * ONE_DEG_IN_RAD;
+	float c = cos(rad);
+	float s = sin(rad);
+	affine r = a;
+	for (int col = 0; col < 4; col++) {
+		r.m[col] = c * a.m[col] - s * a.m[4 + col];
+		r.m[4 + col] = s * a.m[col] + c * a.m[4 + col];
+	}
+	return r;
+}
+
+inline affine scale(const affine& a, const vec3& v) {
+	affine r;
+	for (int col = 0; col < 4; col++) {
+		r.m[col] = a.m[col] * v.v[0];
+		r.m[4 + col] = a.m[4 + col] * v.v[1];
+		r.m[8 + col] = a.m[8 + col] * v.v[2];
+	}
+	return r;
+}
+
+constexpr vec3 transform_point(const affine& a, const vec3& p) {
+	return vec3(
+		a.m[0] * p.v[0] + a.m[1] * p.v[1] + a.m[2] * p.v[2] + a.m[3],
+		a.m[4] * p.v[0] + a.m[5] * p.v[1] + a.m[6] * p.v[2] + a.m[7],
+		a.m[8] * p.v[0] + a.m[9] * p.v[1] + a.m[10] * p.v[2] + a.m[11]
+	);
+}
+
+constexpr vec3 transform_direction(const affine& a, const vec3& d) {
+	return vec3(
+		a.m[0] * d.v[0] + a.m[1] * d.v[1] + a.m[2] * d.v[2],
+		a.m[4] * d.v[0] + a.m[5] * d.v[1] + a.m[6] * d.v[2],
+		a.m[8] * d.v[0] + a.m[9] * d.v[1] + a.m[10] * d.v[2]
+	);
+}
+
+/*--------------------------------AFFINE MATRIX FUNCTIONS-----------------------------*/
+
+// these all pre-multiply m by the transform, same as building the transform and
+// doing transform * m, but only the rows the transform actually changes are
+// touched instead of going through a full 4x4 multiply
+
+// translate a 4d matrix with xyz array
+constexpr mat4 translate(const mat4& m, const vec3& v) {
+	return mat4(
+		m.m[0] + m.m[3] * v.v[0], m.m[4] + m.m[7] * v.v[0], m.m[8] + m.m[11] * v.v[0], m.m[12] + m.m[15] * v.v[0],
+		m.m[1] + m.m[3] * v.v[1], m.m[5] + m.m[7] * v.v[1], m.m[9] + m.m[11] * v.v[1], m.m[13] + m.m[15] * v.v[1],
+		m.m[2] + m.m[3] * v.v[2], m.m[6] + m.m[7] * v.v[2], m.m[10] + m.m[11] * v.v[2], m.m[14] + m.m[15] * v.v[2],
+		m.m[3], m.m[7], m.m[11], m.m[15]
+	);
+}
+
+// rotate around x axis by an angle in degrees
+inline mat4 rotate_x_deg(const mat4& m, float deg) {
+	// convert to radians
+	float rad = deg * ONE_DEG_IN_RAD;
+	float c = cos(rad);
+	float s = sin(rad);
+	mat4 r = m;
+	for (int col = 0; col < 16; col += 4) {
+		r.m[col + 1] = c * m.m[col + 1] - s * m.m[col + 2];
+		r.m[col + 2] = s * m.m[col + 1] + c * m.m[col + 2];
+	}
+	return r;
+}
+
+// rotate around y axis by an angle in degrees
+inline mat4 rotate_y_deg(const mat4& m, float deg) {
+	// convert to radians
+	float rad = deg * ONE_DEG_IN_RAD;
+	float c = cos(rad);
+	float s = sin(rad);
+	mat4 r = m;
+	for (int col = 0; col < 16; col += 4) {
+		r.m[col] = c * m.m[col] + s * m.m[col + 2];
+		r.m[col + 2] = c * m.m[col + 2] - s * m.m[col];
+	}
+	return r;
+}
+
+// rotate around z axis by an angle in degrees
+inline mat4 rotate_z_deg(const mat4& m, float deg) {
+	// convert to radians
+	float rad = deg * ONE_DEG_IN_RAD;
+	float c = cos(rad);
+	float s = sin(rad);
+	mat4 r = m;
+	for (int col = 0; col < 16; col += 4) {
+		r.m[col] = c * m.m[col] - s * m.m[col + 1];
+		r.m[col + 1] = s * m.m[col] + c * m.m[col + 1];
+	}
+	return r;
+}
+
+// scale a matrix by [x, y, z]
+constexpr mat4 scale(const mat4& m, const vec3& v) {
+	return mat4(
+		m.m[0] * v.v[0], m.m[4] * v.v[0], m.m[8] * v.v[0], m.m[12] * v.v[0],
+		m.m[1] * v.v[1], m.m[5] * v.v[1], m.m[9] * v.v[1], m.m[13] * v.v[1],
+		m.m[2] * v.v[2], m.m[6] * v.v[2], m.m[10] * v.v[2], m.m[14] * v.v[2],
+		m.m[3], m.m[7], m.m[11], m.m[15]
+	);
+}
+#endif
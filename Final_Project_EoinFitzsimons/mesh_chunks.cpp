@@ -0,0 +1,651 @@
+#include "mesh_chunks.h"
+#include "vec3_soa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*-------------------------------------FILE LAYOUT------------------------------------*/
+
+/* <source>.chunks:
+header  | 80 bytes
+chunks  | each a mesh cache image, starting on a 16 byte boundary
+table   | a mesh_chunk for each, at table_offset, ending the file */
+struct chunk_file_header {
+	char magic[4];
+	unsigned int version;
+	long long source_mtime;
+	long long source_size;
+	long long table_offset;
+	long long triangle_count;
+	unsigned int chunk_count;
+	unsigned int max_vertex_bytes;
+	unsigned int max_index_bytes;
+	unsigned int mesh_version; // MESH_CACHE_VERSION the chunks were written with
+	aabb bounds;
+};
+static_assert(sizeof(chunk_file_header) == 80, "chunk file header layout changed, bump MESH_CHUNKS_VERSION");
+static_assert(sizeof(mesh_chunk) == 48, "chunk table layout changed, bump MESH_CHUNKS_VERSION");
+
+static const char chunk_file_magic[4] = { 'M', 'S', 'H', 'K' };
+
+static std::string chunk_file_name(const char* source_name) {
+	return std::string(source_name) + ".chunks";
+}
+
+/*--------------------------------------OBJ READING-----------------------------------*/
+
+// the next line of fp into line, without its line ending. false at the end
+static bool read_line(FILE* fp, std::string& line) {
+	line.clear();
+	char buf[4096];
+	while (fgets(buf, sizeof(buf), fp)) {
+		size_t n = strlen(buf);
+		if (n > 0 && '\n' == buf[n - 1]) {
+			n--;
+			if (n > 0 && '\r' == buf[n - 1]) {
+				n--;
+			}
+			line.append(buf, n);
+			return true;
+		}
+		line.append(buf, n);
+	}
+	return !line.empty();
+}
+
+// up to count floats from p into out. returns how many there were
+static int parse_floats(const char* p, float* out, int count) {
+	int n = 0;
+	while (n < count) {
+		char* end;
+		float f = strtof(p, &end);
+		if (end == p) {
+			break;
+		}
+		out[n++] = f;
+		p = end;
+	}
+	return n;
+}
+
+// an obj index to a 0-based one. negative ones count back from the last
+// defined so far. -1 if it's out of range
+static long long obj_index(long long i, long long defined) {
+	long long r = (i > 0) ? i - 1 : defined + i;
+	return (i != 0 && r >= 0 && r < defined) ? r : -1;
+}
+
+// one face corner's position, uv and normal indices, 0-based, -1 if missing.
+// false if the position is, or at the end of the line or a # comment
+static bool parse_corner(const char*& p, const long long defined[3], long long out[3]) {
+	while (' ' == *p || '\t' == *p) {
+		p++;
+	}
+	if (0 == *p || '#' == *p) {
+		return false;
+	}
+	out[0] = out[1] = out[2] = -1;
+	for (int k = 0; k < 3; k++) {
+		char* end;
+		long long i = strtoll(p, &end, 10);
+		if (end != p) {
+			out[k] = obj_index(i, defined[k]);
+			if (out[k] < 0) {
+				return false;
+			}
+		} else if (0 == k) {
+			return false;
+		}
+		p = end;
+		if ('/' != *p) {
+			break;
+		}
+		p++;
+	}
+	// skip whatever's left of a malformed corner
+	while (*p && ' ' != *p && '\t' != *p && '#' != *p) {
+		p++;
+	}
+	return true;
+}
+
+// how many corners a face line has, without checking them. a # starts a
+// comment that runs to the end of the line
+static int count_face_corners(const char* p) {
+	int n = 0;
+	while (*p && '#' != *p) {
+		while (' ' == *p || '\t' == *p) {
+			p++;
+		}
+		if (*p && '#' != *p) {
+			n++;
+		}
+		while (*p && ' ' != *p && '\t' != *p && '#' != *p) {
+			p++;
+		}
+	}
+	return n;
+}
+
+/*--------------------------------------CONVERSION------------------------------------*/
+
+// one triangle corner, the same attributes weld_vertices takes
+struct chunk_corner {
+	vec3 p;
+	vec3 n;
+	vec2 t;
+};
+
+// a run of one cell's triangles in the spill file
+struct spill_block {
+	long long offset;
+	long long triangles;
+};
+
+struct chunk_cell {
+	std::vector<chunk_corner> waiting; // not spilled yet
+	std::vector<spill_block> blocks;
+	long long triangles = 0;
+};
+
+// a cubic grid over the bounds, with about CHUNK_MAX_TRIANGLES / 2 triangles
+// in each occupied cell. scans are surfaces, so the triangles fill about
+// n^2 of an n^3 grid rather than all of it
+struct chunk_grid {
+	aabb bounds;
+	float cell_size;
+	int dims[3];
+};
+
+static chunk_grid make_grid(const aabb& bounds, long long triangles) {
+	chunk_grid g;
+	g.bounds = bounds;
+	vec3 extent = bounds.mx - bounds.mn;
+	float longest = std::max(extent.v[0], std::max(extent.v[1], extent.v[2]));
+	int n = (int)ceil(sqrt((double)triangles / (CHUNK_MAX_TRIANGLES / 2)));
+	n = std::min(std::max(n, 1), 1024);
+	g.cell_size = (longest > 0.0f) ? longest / n : 1.0f;
+	for (int k = 0; k < 3; k++) {
+		g.dims[k] = std::min(std::max((int)ceil(extent.v[k] / g.cell_size), 1), 1024);
+	}
+	return g;
+}
+
+static unsigned int grid_cell(const chunk_grid& g, const vec3& p) {
+	int c[3];
+	for (int k = 0; k < 3; k++) {
+		c[k] = (int)((p.v[k] - g.bounds.mn.v[k]) / g.cell_size);
+		c[k] = std::min(std::max(c[k], 0), g.dims[k] - 1);
+	}
+	return (unsigned int)(c[0] + g.dims[0] * (c[1] + g.dims[1] * c[2]));
+}
+
+// write every cell's waiting triangles to the spill file and free them
+static bool spill_cells(std::unordered_map<unsigned int, chunk_cell>& cells, FILE* spill) {
+	for (std::unordered_map<unsigned int, chunk_cell>::iterator it = cells.begin(); it != cells.end(); ++it) {
+		chunk_cell& c = it->second;
+		if (c.waiting.empty()) {
+			continue;
+		}
+		spill_block b;
+		b.offset = tell_file(spill);
+		b.triangles = (long long)c.waiting.size() / 3;
+		if (fwrite(c.waiting.data(), sizeof(chunk_corner), c.waiting.size(), spill) != c.waiting.size()) {
+			return false;
+		}
+		c.blocks.push_back(b);
+		std::vector<chunk_corner>().swap(c.waiting);
+	}
+	return true;
+}
+
+/* give vertices that came without a normal the area weighted average of the
+facings of every triangle around their position. only the chunk's own
+triangles count, so along a seam the normals can be a little different from
+the neighbouring chunk's */
+static void smooth_missing_normals(ModelData& m) {
+	size_t n = m.mPointCount;
+	std::vector<unsigned int> missing;
+	for (size_t i = 0; i < n; i++) {
+		const vec3& v = m.mNormals[i];
+		if (0.0f == v.v[0] && 0.0f == v.v[1] && 0.0f == v.v[2]) {
+			missing.push_back((unsigned int)i);
+		}
+	}
+	if (missing.empty()) {
+		return;
+	}
+	// vertices only differing by uv sit at the same position, and get the same normal
+	std::vector<unsigned int> order(n);
+	for (size_t i = 0; i < n; i++) {
+		order[i] = (unsigned int)i;
+	}
+	const std::vector<vec3>& pos = m.mVertices;
+	std::sort(order.begin(), order.end(), [&pos](unsigned int a, unsigned int b) {
+		return memcmp(pos[a].v, pos[b].v, sizeof(vec3)) < 0;
+	});
+	std::vector<unsigned int> group(n);
+	unsigned int groups = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (i > 0 && memcmp(pos[order[i]].v, pos[order[i - 1]].v, sizeof(vec3)) != 0) {
+			groups++;
+		}
+		group[order[i]] = groups;
+	}
+	// every triangle's facing in one go, with the corners split out into
+	// streams. the cross product's length is twice the area, which does the
+	// weighting
+	int tri_count = (int)(m.mIndices.size() / 3);
+	vec3_soa p0(tri_count), e1(tri_count), e2(tri_count);
+	for (int t = 0; t < tri_count; t++) {
+		const unsigned int* tri = &m.mIndices[t * 3];
+		p0.set(t, pos[tri[0]]);
+		e1.set(t, pos[tri[1]]);
+		e2.set(t, pos[tri[2]]);
+	}
+	sub(e1, p0, e1);
+	sub(e2, p0, e2);
+	cross(e1, e2, e1);
+	std::vector<vec3> sums(groups + 1, vec3(0.0f, 0.0f, 0.0f));
+	for (int t = 0; t < tri_count; t++) {
+		const unsigned int* tri = &m.mIndices[t * 3];
+		vec3 facing = e1.get(t);
+		for (int c = 0; c < 3; c++) {
+			sums[group[tri[c]]] += facing;
+		}
+	}
+	for (size_t i = 0; i < missing.size(); i++) {
+		vec3 s = sums[group[missing[i]]];
+		// a vertex only on degenerate triangles still needs some unit normal
+		m.mNormals[missing[i]] = (length2(s) > 0.0f) ? s : vec3(0.0f, 0.0f, 1.0f);
+	}
+}
+
+// weld and optimise one chunk's corners, and append it to out as a mesh image
+static bool write_chunk(const std::vector<vec3>& points, const std::vector<vec3>& normals,
+	const std::vector<vec2>& uvs, unsigned int cell, FILE* out, std::vector<mesh_chunk>& table,
+	chunk_file_header& h) {
+	ModelData m;
+	weld_vertices(points.data(), normals.data(), uvs.data(), (int)points.size(), m);
+	smooth_missing_normals(m);
+	// optimise_mesh without its stats, which would be one line per chunk
+	std::vector<int> clusters;
+	optimise_vertex_cache(m, &clusters);
+	optimise_overdraw(m, clusters);
+	optimise_vertex_fetch(m);
+	normalise_vec3s(m.mNormals.data(), m.mNormals.data(), (int)m.mNormals.size());
+	// conversion already runs a chunk at a time, so keep it on one thread
+	generate_tangents(m, 1);
+	m.mBounds = aabb_from_points(m.mVertices.data(), (int)m.mVertices.size());
+
+	mesh_mapping mm;
+	map_model(m, mm);
+	// each image starts on a 16 byte boundary, so its own alignment holds in the mapping
+	static const char zeros[16] = { 0 };
+	long long at = tell_file(out);
+	size_t pad = (size_t)((16 - (at & 15)) & 15);
+	if (fwrite(zeros, 1, pad, out) != pad || fwrite(mm.owned.data(), 1, mm.owned.size(), out) != mm.owned.size()) {
+		return false;
+	}
+	mesh_chunk c;
+	c.offset = at + (long long)pad;
+	c.size = (long long)mm.owned.size();
+	c.bounds = mm.bounds;
+	c.triangle_count = (unsigned int)(m.mIndices.size() / 3);
+	c.cell = cell;
+	table.push_back(c);
+	h.max_vertex_bytes = std::max(h.max_vertex_bytes, (unsigned int)mm.vertex_bytes);
+	h.max_index_bytes = std::max(h.max_index_bytes, (unsigned int)mm.index_bytes);
+	h.triangle_count += c.triangle_count;
+	return true;
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the temporary files conversion makes next to the output
+struct convert_files {
+	std::string positions, normals, uvs, spill, out;
+	FILE* fp[5];
+	mapped_file maps[3];
+
+	explicit convert_files(const std::string& base) : positions(base + ".positions.tmp"),
+		normals(base + ".normals.tmp"), uvs(base + ".uvs.tmp"), spill(base + ".spill.tmp"), out(base + ".tmp") {
+		for (int i = 0; i < 5; i++) {
+			fp[i] = NULL;
+		}
+	}
+	// closes and deletes them all. out is only still there if conversion failed
+	~convert_files() {
+		for (int i = 0; i < 3; i++) {
+			unmap_file(maps[i]);
+		}
+		const std::string* names[5] = { &positions, &normals, &uvs, &spill, &out };
+		for (int i = 0; i < 5; i++) {
+			if (fp[i]) {
+				fclose(fp[i]);
+			}
+			remove(names[i]->c_str());
+		}
+	}
+};
+
+bool convert_chunked(const char* source_name, const char* chunk_name, size_t memory_budget) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	chunk_file_header h = chunk_file_header();
+	memcpy(h.magic, chunk_file_magic, 4);
+	h.version = MESH_CHUNKS_VERSION;
+	h.mesh_version = MESH_CACHE_VERSION;
+	if (!file_stamp(source_name, h.source_mtime, h.source_size)) {
+		fprintf(stderr, "ERROR: reading mesh %s\n", source_name);
+		return false;
+	}
+	FILE* in = open_file(source_name, "rb");
+	if (!in) {
+		fprintf(stderr, "ERROR: reading mesh %s\n", source_name);
+		return false;
+	}
+	convert_files files(chunk_name);
+	FILE*& pos_fp = files.fp[0];
+	FILE*& nrm_fp = files.fp[1];
+	FILE*& uv_fp = files.fp[2];
+	FILE*& spill = files.fp[3];
+	FILE*& out = files.fp[4];
+	pos_fp = open_file(files.positions.c_str(), "wb");
+	nrm_fp = open_file(files.normals.c_str(), "wb");
+	uv_fp = open_file(files.uvs.c_str(), "wb");
+	if (!pos_fp || !nrm_fp || !uv_fp) {
+		fprintf(stderr, "ERROR: could not write the temporary files for %s\n", chunk_name);
+		fclose(in);
+		return false;
+	}
+
+	// first pass: the vertex attributes out to their own files, the bounds, and
+	// how many triangles there are to size the grid
+	long long counts[3] = { 0, 0, 0 }; // positions, uvs, normals, in face corner order
+	bool any = false;
+	std::string line;
+	bool ok = true;
+	while (ok && read_line(in, line)) {
+		const char* p = line.c_str();
+		while (' ' == *p || '\t' == *p) {
+			p++;
+		}
+		float f[3] = { 0.0f, 0.0f, 0.0f };
+		if ('v' == p[0] && (' ' == p[1] || '\t' == p[1])) {
+			parse_floats(p + 2, f, 3);
+			vec3 v(f[0], f[1], f[2]);
+			ok = fwrite(&v, sizeof(v), 1, pos_fp) == 1;
+			if (!any) {
+				h.bounds = aabb(v, v);
+				any = true;
+			}
+			for (int k = 0; k < 3; k++) {
+				h.bounds.mn.v[k] = std::min(h.bounds.mn.v[k], f[k]);
+				h.bounds.mx.v[k] = std::max(h.bounds.mx.v[k], f[k]);
+			}
+			counts[0]++;
+		} else if ('v' == p[0] && 't' == p[1]) {
+			parse_floats(p + 2, f, 2);
+			vec2 t(f[0], f[1]);
+			ok = fwrite(&t, sizeof(t), 1, uv_fp) == 1;
+			counts[1]++;
+		} else if ('v' == p[0] && 'n' == p[1]) {
+			parse_floats(p + 2, f, 3);
+			vec3 n(f[0], f[1], f[2]);
+			ok = fwrite(&n, sizeof(n), 1, nrm_fp) == 1;
+			counts[2]++;
+		} else if ('f' == p[0] && (' ' == p[1] || '\t' == p[1])) {
+			int corners = count_face_corners(p + 2);
+			h.triangle_count += (corners >= 3) ? corners - 2 : 0;
+		}
+	}
+	ok = (0 == fclose(pos_fp)) && ok;
+	ok = (0 == fclose(nrm_fp)) && ok;
+	ok = (0 == fclose(uv_fp)) && ok;
+	pos_fp = nrm_fp = uv_fp = NULL;
+	if (!ok || 0 == h.triangle_count) {
+		fprintf(stderr, "ERROR: %s has no triangles, or the temporary files couldn't be written\n", source_name);
+		fclose(in);
+		return false;
+	}
+	long long expected_triangles = h.triangle_count;
+	h.triangle_count = 0;
+	printf("  %s pass 1: %lld positions, %lld uvs, %lld normals, %lld triangles in %.1f ms\n", source_name,
+		counts[0], counts[1], counts[2], expected_triangles, ms_since(start));
+
+	// the attributes are looked up in any order from here, so they're mapped
+	// and the OS pages them in and out as needed. an empty file doesn't map,
+	// which is fine as nothing will look in it
+	const std::string* attribute_files[3] = { &files.positions, &files.uvs, &files.normals };
+	for (int k = 0; k < 3; k++) {
+		if (!map_file(attribute_files[k]->c_str(), files.maps[k]) && counts[k] > 0) {
+			fprintf(stderr, "ERROR: could not write the temporary files for %s\n", chunk_name);
+			fclose(in);
+			return false;
+		}
+	}
+	const vec3* positions = (const vec3*)files.maps[0].data;
+	const vec2* uvs = (const vec2*)files.maps[1].data;
+	const vec3* normals = (const vec3*)files.maps[2].data;
+
+	// second pass: every triangle into the cell its middle is in, spilling the
+	// lot to disk whenever too much is waiting
+	std::chrono::steady_clock::time_point pass_start = std::chrono::steady_clock::now();
+	chunk_grid grid = make_grid(h.bounds, expected_triangles);
+	std::unordered_map<unsigned int, chunk_cell> cells;
+	spill = open_file(files.spill.c_str(), "w+b");
+	if (!spill) {
+		fprintf(stderr, "ERROR: could not write the temporary files for %s\n", chunk_name);
+		fclose(in);
+		return false;
+	}
+	rewind(in);
+	long long defined[3] = { 0, 0, 0 };
+	size_t waiting_bytes = 0;
+	int spills = 0;
+	long long skipped = 0;
+	std::vector<chunk_corner> face;
+	while (ok && read_line(in, line)) {
+		const char* p = line.c_str();
+		while (' ' == *p || '\t' == *p) {
+			p++;
+		}
+		if ('v' == p[0]) {
+			// only counted, for resolving negative indices
+			if (' ' == p[1] || '\t' == p[1]) {
+				defined[0]++;
+			} else if ('t' == p[1]) {
+				defined[1]++;
+			} else if ('n' == p[1]) {
+				defined[2]++;
+			}
+			continue;
+		}
+		if ('f' != p[0] || (' ' != p[1] && '\t' != p[1])) {
+			continue;
+		}
+		p += 2;
+		face.clear();
+		long long idx[3];
+		while (parse_corner(p, defined, idx)) {
+			chunk_corner c;
+			c.p = positions[idx[0]];
+			c.t = (idx[1] >= 0) ? uvs[idx[1]] : vec2(0.0f, 0.0f);
+			c.n = (idx[2] >= 0) ? normals[idx[2]] : vec3(0.0f, 0.0f, 0.0f);
+			face.push_back(c);
+		}
+		// parse_corner stops short of the end (or a comment) on a bad index
+		bool good = 0 == *p || '#' == *p;
+		if (!good || face.size() < 3) {
+			skipped++;
+			continue;
+		}
+		// a fan around the first corner
+		for (size_t k = 1; k + 1 < face.size(); k++) {
+			vec3 middle = (face[0].p + face[k].p + face[k + 1].p) * (1.0f / 3.0f);
+			chunk_cell& cell = cells[grid_cell(grid, middle)];
+			cell.waiting.push_back(face[0]);
+			cell.waiting.push_back(face[k]);
+			cell.waiting.push_back(face[k + 1]);
+			cell.triangles++;
+			waiting_bytes += 3 * sizeof(chunk_corner);
+		}
+		if (waiting_bytes > memory_budget) {
+			ok = spill_cells(cells, spill);
+			waiting_bytes = 0;
+			spills++;
+		}
+	}
+	fclose(in);
+	ok = ok && spill_cells(cells, spill) && 0 == fflush(spill);
+	if (!ok) {
+		fprintf(stderr, "ERROR: could not write the temporary files for %s\n", chunk_name);
+		return false;
+	}
+	if (skipped > 0) {
+		fprintf(stderr, "WARNING. skipped %lld faces in %s with bad or too few corners\n", skipped, source_name);
+	}
+	printf("  %s pass 2: %i cells in a %ix%ix%i grid, %i spills to disk in %.1f ms\n", source_name,
+		(int)cells.size(), grid.dims[0], grid.dims[1], grid.dims[2], spills, ms_since(pass_start));
+
+	// then each cell, in order, a chunk of up to CHUNK_MAX_TRIANGLES at a time
+	pass_start = std::chrono::steady_clock::now();
+	out = open_file(files.out.c_str(), "wb");
+	if (!out || fwrite(&h, sizeof(h), 1, out) != 1) {
+		fprintf(stderr, "ERROR: could not write %s\n", chunk_name);
+		return false;
+	}
+	std::vector<unsigned int> cell_ids;
+	cell_ids.reserve(cells.size());
+	for (std::unordered_map<unsigned int, chunk_cell>::iterator it = cells.begin(); it != cells.end(); ++it) {
+		cell_ids.push_back(it->first);
+	}
+	std::sort(cell_ids.begin(), cell_ids.end());
+	std::vector<mesh_chunk> table;
+	std::vector<chunk_corner> block;
+	std::vector<vec3> piece_points, piece_normals;
+	std::vector<vec2> piece_uvs;
+	for (size_t c_i = 0; ok && c_i < cell_ids.size(); c_i++) {
+		unsigned int id = cell_ids[c_i];
+		const std::vector<spill_block>& blocks = cells[id].blocks;
+		piece_points.clear();
+		piece_normals.clear();
+		piece_uvs.clear();
+		for (size_t b = 0; ok && b < blocks.size(); b++) {
+			long long left = blocks[b].triangles;
+			ok = seek_file(spill, blocks[b].offset);
+			while (ok && left > 0) {
+				long long room = CHUNK_MAX_TRIANGLES - (long long)piece_points.size() / 3;
+				size_t n = (size_t)std::min(left, room) * 3;
+				block.resize(n);
+				ok = fread(block.data(), sizeof(chunk_corner), n, spill) == n;
+				for (size_t i = 0; ok && i < n; i++) {
+					piece_points.push_back(block[i].p);
+					piece_normals.push_back(block[i].n);
+					piece_uvs.push_back(block[i].t);
+				}
+				left -= (long long)n / 3;
+				if (ok && piece_points.size() == CHUNK_MAX_TRIANGLES * 3) {
+					ok = write_chunk(piece_points, piece_normals, piece_uvs, id, out, table, h);
+					piece_points.clear();
+					piece_normals.clear();
+					piece_uvs.clear();
+				}
+			}
+		}
+		if (ok && !piece_points.empty()) {
+			ok = write_chunk(piece_points, piece_normals, piece_uvs, id, out, table, h);
+		}
+	}
+	if (ok) {
+		h.table_offset = tell_file(out);
+		h.chunk_count = (unsigned int)table.size();
+		ok = fwrite(table.data(), sizeof(mesh_chunk), table.size(), out) == table.size() &&
+			seek_file(out, 0) && fwrite(&h, sizeof(h), 1, out) == 1;
+	}
+	ok = (0 == fclose(out)) && ok;
+	out = NULL;
+	if (!ok || !replace_file(files.out.c_str(), chunk_name)) {
+		fprintf(stderr, "ERROR: could not write %s\n", chunk_name);
+		return false;
+	}
+	printf("  %s: %lld triangles in %i chunks (largest %.1f KB + %.1f KB) in %.1f ms, %.1f ms in all\n",
+		chunk_name, h.triangle_count, (int)h.chunk_count, h.max_vertex_bytes / 1024.0, h.max_index_bytes / 1024.0,
+		ms_since(pass_start), ms_since(start));
+	return true;
+}
+
+/*--------------------------------------MAPPING---------------------------------------*/
+
+// is this a whole chunk file for the source as it is now? the chunks' own
+// images are checked as they're used
+static bool check_chunk_file(const char* source_name, const mapped_file& mf, chunk_file_header& h) {
+	long long mtime, size;
+	if (mf.size < sizeof(h) || !file_stamp(source_name, mtime, size)) {
+		return false;
+	}
+	memcpy(&h, mf.data, sizeof(h));
+	if (0 != memcmp(h.magic, chunk_file_magic, 4) || MESH_CHUNKS_VERSION != h.version ||
+		MESH_CACHE_VERSION != h.mesh_version || mtime != h.source_mtime || size != h.source_size ||
+		h.table_offset < (long long)sizeof(h) || (h.table_offset & 7) != 0 ||
+		(unsigned long long)h.table_offset + (unsigned long long)h.chunk_count * sizeof(mesh_chunk) != mf.size) {
+		return false;
+	}
+	const mesh_chunk* chunks = (const mesh_chunk*)((const char*)mf.data + h.table_offset);
+	for (unsigned int i = 0; i < h.chunk_count; i++) {
+		if (chunks[i].offset < (long long)sizeof(h) || (chunks[i].offset & 15) != 0 || chunks[i].size <= 0 ||
+			chunks[i].offset + chunks[i].size > h.table_offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool map_chunked_mesh(const char* source_name, chunked_mesh& cm) {
+	unmap_chunked_mesh(cm);
+	std::string path = chunk_file_name(source_name);
+	chunk_file_header h;
+	bool ok = map_file(path.c_str(), cm.file) && check_chunk_file(source_name, cm.file, h);
+	if (!ok) {
+		printf("  %s is missing or out of date, converting %s\n", path.c_str(), source_name);
+		unmap_file(cm.file);
+		ok = convert_chunked(source_name, path.c_str()) && map_file(path.c_str(), cm.file) &&
+			check_chunk_file(source_name, cm.file, h);
+		if (!ok) {
+			unmap_file(cm.file);
+			return false;
+		}
+	}
+	cm.chunks = (const mesh_chunk*)((const char*)cm.file.data + h.table_offset);
+	cm.chunk_count = (int)h.chunk_count;
+	cm.triangle_count = h.triangle_count;
+	cm.bounds = h.bounds;
+	cm.max_vertex_bytes = h.max_vertex_bytes;
+	cm.max_index_bytes = h.max_index_bytes;
+	return true;
+}
+
+void unmap_chunked_mesh(chunked_mesh& cm) {
+	unmap_file(cm.file);
+	cm.chunks = NULL;
+	cm.chunk_count = 0;
+	cm.triangle_count = 0;
+	cm.max_vertex_bytes = 0;
+	cm.max_index_bytes = 0;
+}
+
+bool chunk_mapping(const chunked_mesh& cm, int chunk, mesh_mapping& mm) {
+	if (chunk < 0 || chunk >= cm.chunk_count) {
+		return false;
+	}
+	const mesh_chunk& c = cm.chunks[chunk];
+	return view_mesh_image((const char*)cm.file.data + c.offset, (size_t)c.size, mm);
+}
@@ -0,0 +1,68 @@
+#ifndef _MESH_CHUNKS_H_
+#define _MESH_CHUNKS_H_
+
+#include <stddef.h>
+#include "maths_funcs.h"
+#include "mesh_funcs.h"
+#include "file_funcs.h"
+
+/* meshes too big to hold in memory, like big scans. load_mesh keeps a whole
+mesh three times over (assimp's scene, the ModelData and the GL buffers), so
+instead the model is converted once, a piece at a time, into a file of
+chunks, and the renderer pages chunks in and out of a fixed set of GPU
+buffers by what's on screen.
+
+each chunk is the triangles whose middles fall in one cell of a grid over the
+model, welded, optimised and stored as a mesh cache image (see mesh_funcs.h),
+so it's uploaded and drawn like any other mesh. chunks don't share vertices
+and there are no levels of detail, so nothing can crack along the seams */
+
+// the most triangles in one chunk. a cell with more is split into several
+// chunks. small enough that most chunks get 16-bit indices
+#define CHUNK_MAX_TRIANGLES 32768
+// what conversion may hold in memory at once for triangles waiting to be
+// sorted into chunks, on top of one chunk being built
+#define CHUNK_MEMORY_BUDGET (64 * 1024 * 1024)
+// bump whenever the chunk file layout changes. the chunks themselves are mesh
+// cache images, so MESH_CACHE_VERSION covers them
+#define MESH_CHUNKS_VERSION 1
+
+// where a chunk is in the file and what it's for culling
+struct mesh_chunk {
+	long long offset; // of its mesh image, from the start of the file
+	long long size;
+	aabb bounds;
+	unsigned int triangle_count;
+	unsigned int cell; // which grid cell it came from
+};
+
+/* a converted model, mapped. only what the renderer touches gets paged in, so
+the memory it takes is up to the OS rather than the size of the model */
+struct chunked_mesh {
+	mapped_file file;
+	const mesh_chunk* chunks = NULL; // in the mapping
+	int chunk_count = 0;
+	long long triangle_count = 0;
+	aabb bounds;
+	// the biggest any chunk's buffers get, so a GPU buffer of this size fits any
+	size_t max_vertex_bytes = 0;
+	size_t max_index_bytes = 0;
+};
+
+/* convert a Wavefront obj file into chunks, streaming it from disk. obj is the
+format here because it can be read a line at a time: assimp wants the whole
+file in memory. the file is read twice. the first pass copies the vertex
+attributes out to temporary files, which are then mapped so faces can look
+them up, and the second sorts the triangles into grid cells, spilling them to
+another temporary file whenever more than memory_budget bytes are waiting.
+then each cell is built into chunks one at a time. faces with more than 3
+corners are split into fans, and corners without normals get smooth ones made
+from their chunk's triangles */
+bool convert_chunked(const char* source_name, const char* chunk_name, size_t memory_budget = CHUNK_MEMORY_BUDGET);
+// map <source>.chunks, converting the source first if it's missing or out of
+// date
+bool map_chunked_mesh(const char* source_name, chunked_mesh& cm);
+void unmap_chunked_mesh(chunked_mesh& cm);
+// point mm at one chunk's mesh image in the mapping
+bool chunk_mapping(const chunked_mesh& cm, int chunk, mesh_mapping& mm);
+#endif
@@ -0,0 +1,2516 @@
+#include "mesh_funcs.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <string>
+#include <thread>
+#include "file_funcs.h"
+
+// Assimp includes
+#include <assimp/cimport.h> // scene importer
+#include <assimp/scene.h> // collects data
+#include <assimp/postprocess.h> // various extra operations
+
+/*-----------------------------------VERTEX WELDING-----------------------------------*/
+
+// one corner's worth of attributes, hashed and compared as raw bits
+struct weld_vertex {
+	vec3 p;
+	vec3 n;
+	vec2 t;
+};
+
+static unsigned int hash_vertex(const weld_vertex& v) {
+	unsigned int w[8];
+	memcpy(w, &v, sizeof(w));
+	// FNV-1a over the 8 words, then a final mix so the low bits are usable as
+	// a table index
+	unsigned int h = 2166136261u;
+	for (int i = 0; i < 8; i++) {
+		h = (h ^ w[i]) * 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+void weld_vertices(const vec3* points, const vec3* normals, const vec2* uvs, int corner_count, ModelData& out) {
+	// open addressing table of indices into unique, at most half full
+	size_t table_size = 16;
+	while (table_size < (size_t)corner_count * 2) {
+		table_size *= 2;
+	}
+	size_t mask = table_size - 1;
+	std::vector<int> table(table_size, -1);
+	std::vector<weld_vertex> unique;
+	unique.reserve(corner_count);
+
+	out.mIndices.resize(corner_count);
+	for (int i = 0; i < corner_count; i++) {
+		weld_vertex v;
+		v.p = points[i];
+		v.n = normals ? normals[i] : vec3(0.0f, 0.0f, 0.0f);
+		v.t = uvs ? uvs[i] : vec2(0.0f, 0.0f);
+		size_t slot = hash_vertex(v) & mask;
+		while (table[slot] >= 0 && memcmp(&unique[table[slot]], &v, sizeof(weld_vertex)) != 0) {
+			slot = (slot + 1) & mask;
+		}
+		if (table[slot] < 0) {
+			table[slot] = (int)unique.size();
+			unique.push_back(v);
+		}
+		out.mIndices[i] = (unsigned int)table[slot];
+	}
+
+	out.mPointCount = unique.size();
+	out.mVertices.resize(unique.size());
+	out.mNormals.resize(unique.size());
+	out.mTextureCoords.resize(unique.size());
+	for (size_t i = 0; i < unique.size(); i++) {
+		out.mVertices[i] = unique[i].p;
+		out.mNormals[i] = unique[i].n;
+		out.mTextureCoords[i] = unique[i].t;
+	}
+}
+
+bool needs_32bit_indices(const ModelData& mesh) {
+	return mesh.mPointCount > 65535;
+}
+
+void get_16bit_indices(const ModelData& mesh, std::vector<unsigned short>& out) {
+	out.resize(mesh.mIndices.size());
+	for (size_t i = 0; i < mesh.mIndices.size(); i++) {
+		out[i] = (unsigned short)mesh.mIndices[i];
+	}
+}
+
+/*-----------------------------VERTEX CACHE OPTIMISATION------------------------------*/
+
+void cache_stats(const ModelData& mesh, int cache_size, float& acmr, float& atvr) {
+	// a vertex is in the FIFO if fewer than cache_size misses have happened
+	// since it was loaded
+	std::vector<int> loaded_at(mesh.mPointCount, -cache_size - 1);
+	int misses = 0;
+	for (size_t i = 0; i < mesh.mIndices.size(); i++) {
+		unsigned int v = mesh.mIndices[i];
+		if (misses - loaded_at[v] > cache_size) {
+			loaded_at[v] = misses;
+			misses++;
+		}
+	}
+	int tris = (int)mesh.mIndices.size() / 3;
+	acmr = tris > 0 ? (float)misses / tris : 0.0f;
+	atvr = mesh.mPointCount > 0 ? (float)misses / mesh.mPointCount : 0.0f;
+}
+
+// Tipsy's choice of the next vertex to fan around: the one among the last
+// triangles' vertices that will still be in the cache after its remaining
+// triangles are emitted, preferring the oldest. -1 if none fits
+static int tipsy_next_vertex(const std::vector<int>& candidates, const std::vector<int>& live,
+	const std::vector<int>& cache_time, int timestamp, int cache_size) {
+	int best = -1;
+	int best_priority = -1;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		int v = candidates[i];
+		if (live[v] <= 0) {
+			continue;
+		}
+		int priority = 0;
+		if (timestamp - cache_time[v] + 2 * live[v] <= cache_size) {
+			priority = timestamp - cache_time[v];
+		}
+		if (priority > best_priority) {
+			best_priority = priority;
+			best = v;
+		}
+	}
+	return best;
+}
+
+void optimise_vertex_cache(ModelData& mesh, std::vector<int>* clusters) {
+	int vert_count = (int)mesh.mPointCount;
+	int tri_count = (int)mesh.mIndices.size() / 3;
+	const unsigned int* idx = mesh.mIndices.data();
+	if (clusters) {
+		clusters->clear();
+	}
+	if (0 == tri_count) {
+		return;
+	}
+
+	// vertex -> triangle adjacency, as offsets into one flat list
+	std::vector<int> live(vert_count, 0);
+	for (int i = 0; i < tri_count * 3; i++) {
+		live[idx[i]]++;
+	}
+	std::vector<int> adj_start(vert_count + 1, 0);
+	for (int v = 0; v < vert_count; v++) {
+		adj_start[v + 1] = adj_start[v] + live[v];
+	}
+	std::vector<int> adj(tri_count * 3);
+	std::vector<int> fill(adj_start.begin(), adj_start.end() - 1);
+	for (int t = 0; t < tri_count; t++) {
+		for (int k = 0; k < 3; k++) {
+			adj[fill[idx[t * 3 + k]]++] = t;
+		}
+	}
+
+	std::vector<int> cache_time(vert_count, 0);
+	std::vector<int> dead_end;
+	std::vector<char> emitted(tri_count, 0);
+	std::vector<int> candidates;
+	std::vector<unsigned int> out;
+	out.reserve(tri_count * 3);
+	int timestamp = VERTEX_CACHE_SIZE + 1;
+	int cursor = 0;
+	int fan = idx[0];
+	bool cold = true;
+	while (fan >= 0) {
+		if (cold && clusters) {
+			clusters->push_back((int)out.size() / 3);
+		}
+		candidates.clear();
+		for (int a = adj_start[fan]; a < adj_start[fan + 1]; a++) {
+			int t = adj[a];
+			if (emitted[t]) {
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				int v = idx[t * 3 + k];
+				out.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (timestamp - cache_time[v] > VERTEX_CACHE_SIZE) {
+					cache_time[v] = timestamp++;
+				}
+			}
+			emitted[t] = 1;
+		}
+		fan = tipsy_next_vertex(candidates, live, cache_time, timestamp, VERTEX_CACHE_SIZE);
+		cold = false;
+		if (fan < 0) {
+			// dead end: go back to a recently used vertex, or failing that the
+			// next one in the original order that still has triangles. either
+			// way the cache is as good as cold, so a new cluster starts
+			cold = true;
+			while (!dead_end.empty() && fan < 0) {
+				int d = dead_end.back();
+				dead_end.pop_back();
+				if (live[d] > 0) {
+					fan = d;
+				}
+			}
+			while (fan < 0 && cursor < vert_count) {
+				if (live[cursor] > 0) {
+					fan = cursor;
+				}
+				cursor++;
+			}
+		}
+	}
+	mesh.mIndices.swap(out);
+}
+
+// the clusters (runs of triangles starting at clusters[c]) in the order they
+// should be drawn: Sander et al.'s occlusion potential, how far each sits out
+// along its own normal from the middle of the mesh, highest first
+static void occlusion_order(const ModelData& mesh, const std::vector<int>& clusters, std::vector<int>& order) {
+	int tri_count = (int)mesh.mIndices.size() / 3;
+	int cluster_count = (int)clusters.size();
+	const unsigned int* idx = mesh.mIndices.data();
+	const vec3* pts = mesh.mVertices.data();
+
+	// area weighted centre of the whole mesh and of each cluster, and each
+	// cluster's area weighted normal (the sum of the unnormalised face normals)
+	std::vector<vec3> centre(cluster_count, vec3(0.0f, 0.0f, 0.0f));
+	std::vector<vec3> normal(cluster_count, vec3(0.0f, 0.0f, 0.0f));
+	std::vector<float> area(cluster_count, 0.0f);
+	vec3 mesh_centre(0.0f, 0.0f, 0.0f);
+	float mesh_area = 0.0f;
+	for (int c = 0; c < cluster_count; c++) {
+		int end = (c + 1 < cluster_count) ? clusters[c + 1] : tri_count;
+		for (int t = clusters[c]; t < end; t++) {
+			const vec3& a = pts[idx[t * 3]];
+			const vec3& b = pts[idx[t * 3 + 1]];
+			const vec3& d = pts[idx[t * 3 + 2]];
+			vec3 n = cross(b - a, d - a);
+			float tri_area = length(n) * 0.5f;
+			vec3 tri_centre = (a + b + d) * (1.0f / 3.0f);
+			centre[c] += tri_centre * tri_area;
+			normal[c] += n;
+			area[c] += tri_area;
+		}
+		mesh_centre += centre[c];
+		mesh_area += area[c];
+	}
+	if (mesh_area > 0.0f) {
+		mesh_centre = mesh_centre * (1.0f / mesh_area);
+	}
+
+	std::vector<float> sort_key(cluster_count);
+	order.resize(cluster_count);
+	for (int c = 0; c < cluster_count; c++) {
+		vec3 cc = area[c] > 0.0f ? centre[c] * (1.0f / area[c]) : mesh_centre;
+		sort_key[c] = dot(cc - mesh_centre, normalise(normal[c]));
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&sort_key](int a, int b) {
+		return sort_key[a] > sort_key[b];
+	});
+}
+
+void optimise_overdraw(ModelData& mesh, const std::vector<int>& clusters) {
+	int tri_count = (int)mesh.mIndices.size() / 3;
+	int cluster_count = (int)clusters.size();
+	if (cluster_count < 2) {
+		return;
+	}
+	std::vector<int> order;
+	occlusion_order(mesh, clusters, order);
+
+	const unsigned int* idx = mesh.mIndices.data();
+	std::vector<unsigned int> out;
+	out.reserve(mesh.mIndices.size());
+	for (int i = 0; i < cluster_count; i++) {
+		int c = order[i];
+		int end = (c + 1 < cluster_count) ? clusters[c + 1] : tri_count;
+		out.insert(out.end(), idx + clusters[c] * 3, idx + end * 3);
+	}
+	mesh.mIndices.swap(out);
+}
+
+void optimise_vertex_fetch(ModelData& mesh) {
+	std::vector<int> remap(mesh.mPointCount, -1);
+	int next = 0;
+	for (size_t i = 0; i < mesh.mIndices.size(); i++) {
+		unsigned int v = mesh.mIndices[i];
+		if (remap[v] < 0) {
+			remap[v] = next++;
+		}
+		mesh.mIndices[i] = (unsigned int)remap[v];
+	}
+	std::vector<vec3> vertices(next);
+	std::vector<vec3> normals(next);
+	std::vector<vec2> uvs(next);
+	bool has_tangents = mesh.mTangents.size() == mesh.mPointCount;
+	std::vector<vec4> tangents(has_tangents ? next : 0);
+	for (size_t v = 0; v < mesh.mPointCount; v++) {
+		if (remap[v] >= 0) {
+			vertices[remap[v]] = mesh.mVertices[v];
+			normals[remap[v]] = mesh.mNormals[v];
+			uvs[remap[v]] = mesh.mTextureCoords[v];
+			if (has_tangents) {
+				tangents[remap[v]] = mesh.mTangents[v];
+			}
+		}
+	}
+	mesh.mVertices.swap(vertices);
+	mesh.mNormals.swap(normals);
+	mesh.mTextureCoords.swap(uvs);
+	mesh.mTangents.swap(tangents);
+	mesh.mPointCount = next;
+}
+
+void optimise_mesh(ModelData& mesh) {
+	float acmr_before, atvr_before, acmr_after, atvr_after;
+	cache_stats(mesh, VERTEX_CACHE_SIZE, acmr_before, atvr_before);
+	std::vector<int> clusters;
+	optimise_vertex_cache(mesh, &clusters);
+	optimise_overdraw(mesh, clusters);
+	optimise_vertex_fetch(mesh);
+	cache_stats(mesh, VERTEX_CACHE_SIZE, acmr_after, atvr_after);
+	printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%i entry FIFO, %i clusters)\n",
+		acmr_before, acmr_after, atvr_before, atvr_after, VERTEX_CACHE_SIZE, (int)clusters.size());
+}
+
+/*-----------------------------------TANGENT SPACE------------------------------------*/
+
+// run fn(first, last) over 0..count in chunks on up to num_threads threads (0 =
+// one per core), the calling thread taking the first chunk
+template <typename F>
+static void run_chunks(size_t count, size_t min_per_thread, int num_threads, F fn) {
+	if (num_threads <= 0) {
+		num_threads = (int)std::thread::hardware_concurrency();
+	}
+	if ((size_t)num_threads > count / min_per_thread) {
+		num_threads = (int)(count / min_per_thread);
+	}
+	if (num_threads <= 1) {
+		fn((size_t)0, count);
+		return;
+	}
+	size_t chunk = (count + num_threads - 1) / num_threads;
+	std::vector<std::thread> workers;
+	for (int t = 1; t < num_threads; t++) {
+		size_t first = t * chunk;
+		size_t last = (first + chunk > count) ? count : first + chunk;
+		workers.push_back(std::thread(fn, first, last));
+	}
+	fn((size_t)0, chunk);
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+}
+
+// any unit vector at right angles to n, for vertices whose uvs give no direction
+static vec3 any_perpendicular(const vec3& n) {
+	vec3 axis = (fabsf(n.v[0]) < 0.9f) ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+	vec3 t = cross(axis, n);
+	float len = length(t);
+	return len > 0.0f ? t / len : vec3(1.0f, 0.0f, 0.0f);
+}
+
+// the angle at corner c of triangle a b c
+static float corner_angle(const vec3& c, const vec3& a, const vec3& b) {
+	vec3 e1 = a - c;
+	vec3 e2 = b - c;
+	float l = length(e1) * length(e2);
+	if (l <= 0.0f) {
+		return 0.0f;
+	}
+	float d = dot(e1, e2) / l;
+	return acosf(d < -1.0f ? -1.0f : (d > 1.0f ? 1.0f : d));
+}
+
+void generate_tangents(ModelData& mesh, int num_threads) {
+	const size_t tri_count = mesh.mIndices.size() / 3;
+	const unsigned int* idx = mesh.mIndices.data();
+	const size_t min_per_thread = 16384;
+
+	// each triangle's +u direction, and whether its uvs are mirrored. zero if
+	// the uvs don't span anything
+	std::vector<vec3> tri_dir(tri_count);
+	std::vector<signed char> tri_sign(tri_count);
+	run_chunks(tri_count, min_per_thread, num_threads, [&](size_t first, size_t last) {
+		for (size_t t = first; t < last; t++) {
+			const vec3& p0 = mesh.mVertices[idx[t * 3]];
+			const vec2& t0 = mesh.mTextureCoords[idx[t * 3]];
+			vec3 e1 = mesh.mVertices[idx[t * 3 + 1]] - p0;
+			vec3 e2 = mesh.mVertices[idx[t * 3 + 2]] - p0;
+			vec2 d1(mesh.mTextureCoords[idx[t * 3 + 1]].v[0] - t0.v[0], mesh.mTextureCoords[idx[t * 3 + 1]].v[1] - t0.v[1]);
+			vec2 d2(mesh.mTextureCoords[idx[t * 3 + 2]].v[0] - t0.v[0], mesh.mTextureCoords[idx[t * 3 + 2]].v[1] - t0.v[1]);
+			float area = d1.v[0] * d2.v[1] - d2.v[0] * d1.v[1];
+			tri_sign[t] = area < 0.0f ? -1 : 1;
+			// dP/du up to a positive scale, so the uv area's size doesn't matter
+			vec3 dir = (e1 * d2.v[1] - e2 * d1.v[1]) * (float)tri_sign[t];
+			float len = length(dir);
+			tri_dir[t] = (len > 0.0f && 0.0f != area) ? dir / len : vec3(0.0f, 0.0f, 0.0f);
+		}
+	});
+
+	// which corners use each vertex, so every vertex can be summed on its own
+	// thread without any two threads writing the same one
+	std::vector<unsigned int> first_corner(mesh.mPointCount + 1, 0);
+	for (size_t i = 0; i < tri_count * 3; i++) {
+		first_corner[idx[i] + 1]++;
+	}
+	for (size_t v = 0; v < mesh.mPointCount; v++) {
+		first_corner[v + 1] += first_corner[v];
+	}
+	std::vector<unsigned int> corners(tri_count * 3);
+	{
+		std::vector<unsigned int> fill(first_corner.begin(), first_corner.end() - 1);
+		for (size_t i = 0; i < tri_count * 3; i++) {
+			corners[fill[idx[i]]++] = (unsigned int)i;
+		}
+	}
+
+	// per vertex, the angle weighted sums for each handedness. the one with
+	// more weight wins, and split marks vertices that need a twin for the other
+	std::vector<vec3> other_dir(mesh.mPointCount);
+	std::vector<unsigned char> split(mesh.mPointCount, 0);
+	mesh.mTangents.resize(mesh.mPointCount);
+	run_chunks(mesh.mPointCount, min_per_thread, num_threads, [&](size_t first, size_t last) {
+		for (size_t v = first; v < last; v++) {
+			const vec3& n = mesh.mNormals[v];
+			vec3 sum[2] = { vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, 0.0f) };
+			float weight[2] = { 0.0f, 0.0f };
+			for (unsigned int c = first_corner[v]; c < first_corner[v + 1]; c++) {
+				size_t t = corners[c] / 3;
+				int k = corners[c] % 3;
+				// the triangle's direction flattened onto this vertex's tangent plane
+				vec3 d = tri_dir[t] - n * dot(n, tri_dir[t]);
+				float len = length(d);
+				if (len <= 0.0f) {
+					continue;
+				}
+				float angle = corner_angle(mesh.mVertices[v], mesh.mVertices[idx[t * 3 + (k + 1) % 3]],
+					mesh.mVertices[idx[t * 3 + (k + 2) % 3]]);
+				int side = tri_sign[t] < 0;
+				sum[side] = sum[side] + d * (angle / len);
+				weight[side] += angle;
+			}
+			int side = weight[1] > weight[0];
+			float len = length(sum[side]);
+			vec3 tangent = len > 0.0f ? sum[side] / len : any_perpendicular(n);
+			mesh.mTangents[v] = vec4(tangent, side ? -1.0f : 1.0f);
+			if (weight[1 - side] > 0.0f) {
+				float other_len = length(sum[1 - side]);
+				other_dir[v] = other_len > 0.0f ? sum[1 - side] / other_len : any_perpendicular(n);
+				split[v] = 1;
+			}
+		}
+	});
+
+	// give the losing handedness its own copy of each split vertex
+	std::vector<unsigned int> twin(mesh.mPointCount, 0);
+	size_t splits = 0;
+	for (size_t v = 0; v < split.size(); v++) {
+		if (!split[v]) {
+			continue;
+		}
+		twin[v] = (unsigned int)mesh.mVertices.size();
+		vec3 p = mesh.mVertices[v];
+		vec3 n = mesh.mNormals[v];
+		vec2 uv = mesh.mTextureCoords[v];
+		mesh.mVertices.push_back(p);
+		mesh.mNormals.push_back(n);
+		mesh.mTextureCoords.push_back(uv);
+		mesh.mTangents.push_back(vec4(other_dir[v], -mesh.mTangents[v].v[3]));
+		splits++;
+	}
+	if (splits > 0) {
+		for (size_t i = 0; i < tri_count * 3; i++) {
+			unsigned int v = mesh.mIndices[i];
+			if (split[v] && (float)tri_sign[i / 3] != mesh.mTangents[v].v[3]) {
+				mesh.mIndices[i] = twin[v];
+			}
+		}
+		mesh.mPointCount = mesh.mVertices.size();
+		printf("  split %i vertices shared by mirrored uvs\n", (int)splits);
+	}
+}
+
+/*-----------------------------------SIMPLIFICATION-----------------------------------*/
+
+// a symmetric 4x4 error quadric (Garland and Heckbert 1997), plus the total
+// weight of the planes in it so the error comes out as a mean squared distance
+struct quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2, w;
+};
+
+// n is a unit normal, and the plane is n.p + d = 0
+static void add_plane(quadric& q, const vec3& n, float d, double w) {
+	double a = n.v[0], b = n.v[1], c = n.v[2];
+	q.a2 += w * a * a;
+	q.ab += w * a * b;
+	q.ac += w * a * c;
+	q.ad += w * a * d;
+	q.b2 += w * b * b;
+	q.bc += w * b * c;
+	q.bd += w * b * d;
+	q.c2 += w * c * c;
+	q.cd += w * c * d;
+	q.d2 += w * d * d;
+	q.w += w;
+}
+
+static void add_quadric(quadric& q, const quadric& r) {
+	q.a2 += r.a2;
+	q.ab += r.ab;
+	q.ac += r.ac;
+	q.ad += r.ad;
+	q.b2 += r.b2;
+	q.bc += r.bc;
+	q.bd += r.bd;
+	q.c2 += r.c2;
+	q.cd += r.cd;
+	q.d2 += r.d2;
+	q.w += r.w;
+}
+
+static double quadric_error(const quadric& q, const vec3& p) {
+	double x = p.v[0], y = p.v[1], z = p.v[2];
+	double e = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x +
+		q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y +
+		q.c2 * z * z + 2.0 * q.cd * z + q.d2;
+	return (q.w > 0.0 && e > 0.0) ? e / q.w : 0.0;
+}
+
+static unsigned long long edge_key(unsigned int a, unsigned int b) {
+	return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+}
+
+// what the simplifier may do with a vertex
+#define SIMPLIFY_FREE 0 // inside the surface: collapse along any edge
+#define SIMPLIFY_SLIDE 1 // on a border or uv/normal seam: only along that line
+#define SIMPLIFY_LOCKED 2 // where those lines end or meet: never moves
+// how much more keeping borders and seams in place matters than the surface
+#define SIMPLIFY_BORDER_WEIGHT 10.0
+
+// moving position vertex from onto to. costs go on a min heap
+struct collapse {
+	float cost;
+	unsigned int from;
+	unsigned int to;
+	unsigned int from_stamp;
+	unsigned int to_stamp;
+	bool operator< (const collapse& rhs) const { return cost > rhs.cost; }
+};
+
+/* the simplifier works on positions, so the vertices that only differ in
+normal or uv (split along seams) move together. everything here is indexed by
+the first vertex with each position */
+struct simplifier {
+	const ModelData* mesh;
+	std::vector<unsigned int> pos_of; // vertex -> its position's first vertex
+	std::vector<unsigned int> next_twin; // next vertex with the same position, ~0u at the end
+	std::vector<unsigned int> tris; // attribute vertex corners
+	std::vector<char> tri_dead;
+	std::vector<std::vector<unsigned int> > vert_tris; // triangles around each position
+	std::vector<unsigned long long> open_edges; // position edges on a border or seam, sorted
+	std::vector<char> kind;
+	std::vector<quadric> quadrics;
+	std::vector<unsigned int> stamp; // bumped whenever a position's collapses go stale
+	std::vector<char> removed;
+	std::priority_queue<collapse> heap;
+};
+
+static const vec3& sim_pos(const simplifier& s, unsigned int p) {
+	return s.mesh->mVertices[p];
+}
+
+// the other positions that share a live triangle with p, sorted
+static void sim_neighbours(simplifier& s, unsigned int p, std::vector<unsigned int>& out) {
+	out.clear();
+	std::vector<unsigned int>& vt = s.vert_tris[p];
+	size_t kept = 0;
+	for (size_t i = 0; i < vt.size(); i++) {
+		unsigned int t = vt[i];
+		if (s.tri_dead[t]) {
+			continue;
+		}
+		vt[kept++] = t;
+		for (int k = 0; k < 3; k++) {
+			unsigned int q = s.pos_of[s.tris[t * 3 + k]];
+			if (q != p) {
+				out.push_back(q);
+			}
+		}
+	}
+	vt.resize(kept);
+	std::sort(out.begin(), out.end());
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+static void sim_push(simplifier& s, unsigned int from, unsigned int to) {
+	if (SIMPLIFY_LOCKED == s.kind[from]) {
+		return;
+	}
+	if (SIMPLIFY_SLIDE == s.kind[from] &&
+		!std::binary_search(s.open_edges.begin(), s.open_edges.end(), edge_key(from, to))) {
+		return;
+	}
+	quadric q = s.quadrics[from];
+	add_quadric(q, s.quadrics[to]);
+	collapse c;
+	c.cost = (float)quadric_error(q, sim_pos(s, to));
+	c.from = from;
+	c.to = to;
+	c.from_stamp = s.stamp[from];
+	c.to_stamp = s.stamp[to];
+	s.heap.push(c);
+}
+
+// would moving from onto to fold any of the triangles that survive it over, or
+// pinch the surface into a non-manifold fin?
+static bool sim_collapse_ok(simplifier& s, unsigned int from, unsigned int to,
+	std::vector<unsigned int>& n_from, std::vector<unsigned int>& n_to) {
+	sim_neighbours(s, from, n_from);
+	sim_neighbours(s, to, n_to);
+	int shared_tris = 0;
+	for (size_t i = 0; i < s.vert_tris[from].size(); i++) {
+		unsigned int t = s.vert_tris[from][i];
+		unsigned int p[3];
+		bool has_to = false;
+		for (int k = 0; k < 3; k++) {
+			p[k] = s.pos_of[s.tris[t * 3 + k]];
+			has_to = has_to || to == p[k];
+		}
+		if (has_to) {
+			shared_tris++;
+			continue;
+		}
+		vec3 q[3];
+		for (int k = 0; k < 3; k++) {
+			q[k] = sim_pos(s, p[k]);
+		}
+		vec3 before = cross(q[1] - q[0], q[2] - q[0]);
+		for (int k = 0; k < 3; k++) {
+			if (from == p[k]) {
+				q[k] = sim_pos(s, to);
+			}
+		}
+		vec3 after = cross(q[1] - q[0], q[2] - q[0]);
+		// more than about 75 degrees of turn, or squashed flat
+		if (dot(before, after) < 0.25f * length(before) * length(after) || dot(after, after) <= 0.0f) {
+			return false;
+		}
+	}
+	// the link condition: the only positions next to both ends are the far
+	// corners of the triangles the collapse removes
+	int common = 0;
+	size_t i = 0, j = 0;
+	while (i < n_from.size() && j < n_to.size()) {
+		if (n_from[i] < n_to[j]) {
+			i++;
+		} else if (n_from[i] > n_to[j]) {
+			j++;
+		} else {
+			common++;
+			i++;
+			j++;
+		}
+	}
+	return common == shared_tris;
+}
+
+void simplify_indices(const ModelData& mesh, const std::vector<unsigned int>& indices,
+	size_t target_index_count, std::vector<unsigned int>& out, float& error) {
+	size_t vert_count = mesh.mPointCount;
+	size_t tri_count = indices.size() / 3;
+	error = 0.0f;
+	simplifier s;
+	s.mesh = &mesh;
+
+	// group the vertices by position, with the same open addressing as welding
+	s.pos_of.resize(vert_count);
+	s.next_twin.assign(vert_count, ~0u);
+	{
+		size_t table_size = 16;
+		while (table_size < vert_count * 2) {
+			table_size *= 2;
+		}
+		size_t mask = table_size - 1;
+		std::vector<int> table(table_size, -1);
+		for (size_t v = 0; v < vert_count; v++) {
+			weld_vertex key = weld_vertex();
+			key.p = mesh.mVertices[v];
+			size_t slot = hash_vertex(key) & mask;
+			while (table[slot] >= 0 && memcmp(&mesh.mVertices[table[slot]], &key.p, sizeof(vec3)) != 0) {
+				slot = (slot + 1) & mask;
+			}
+			if (table[slot] < 0) {
+				table[slot] = (int)v;
+			}
+			unsigned int first = (unsigned int)table[slot];
+			s.pos_of[v] = first;
+			if (first != v) {
+				s.next_twin[v] = s.next_twin[first];
+				s.next_twin[first] = (unsigned int)v;
+			}
+		}
+	}
+
+	// triangles, minus any that are already degenerate by position
+	s.tris.reserve(indices.size());
+	for (size_t t = 0; t < tri_count; t++) {
+		unsigned int a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+		if (s.pos_of[a] != s.pos_of[b] && s.pos_of[b] != s.pos_of[c] && s.pos_of[a] != s.pos_of[c]) {
+			s.tris.push_back(a);
+			s.tris.push_back(b);
+			s.tris.push_back(c);
+		}
+	}
+	tri_count = s.tris.size() / 3;
+	s.tri_dead.assign(tri_count, 0);
+	s.vert_tris.resize(vert_count);
+	for (size_t t = 0; t < tri_count; t++) {
+		for (int k = 0; k < 3; k++) {
+			s.vert_tris[s.pos_of[s.tris[t * 3 + k]]].push_back((unsigned int)t);
+		}
+	}
+
+	// an edge between attribute vertices with only one triangle is on a border,
+	// or on a seam where the vertices on the other side are different ones
+	std::vector<std::pair<unsigned long long, unsigned int> > corner_edges(tri_count * 3);
+	for (size_t t = 0; t < tri_count; t++) {
+		for (int k = 0; k < 3; k++) {
+			unsigned int a = s.tris[t * 3 + k], b = s.tris[t * 3 + (k + 1) % 3];
+			corner_edges[t * 3 + k] = std::make_pair(edge_key(a, b), (unsigned int)(t * 3 + k));
+		}
+	}
+	std::sort(corner_edges.begin(), corner_edges.end());
+
+	s.quadrics.assign(vert_count, quadric());
+	for (size_t t = 0; t < tri_count; t++) {
+		vec3 a = sim_pos(s, s.pos_of[s.tris[t * 3]]);
+		vec3 n = cross(sim_pos(s, s.pos_of[s.tris[t * 3 + 1]]) - a, sim_pos(s, s.pos_of[s.tris[t * 3 + 2]]) - a);
+		float area2 = length(n);
+		if (area2 <= 0.0f) {
+			continue;
+		}
+		n = n / area2;
+		for (int k = 0; k < 3; k++) {
+			add_plane(s.quadrics[s.pos_of[s.tris[t * 3 + k]]], n, -dot(n, a), 0.5 * area2);
+		}
+	}
+	for (size_t i = 0; i < corner_edges.size(); i++) {
+		bool open = (0 == i || corner_edges[i - 1].first != corner_edges[i].first) &&
+			(corner_edges.size() == i + 1 || corner_edges[i + 1].first != corner_edges[i].first);
+		if (!open) {
+			continue;
+		}
+		unsigned int corner = corner_edges[i].second;
+		unsigned int t = corner / 3;
+		unsigned int pa = s.pos_of[s.tris[corner]];
+		unsigned int pb = s.pos_of[s.tris[t * 3 + (corner % 3 + 1) % 3]];
+		s.open_edges.push_back(edge_key(pa, pb));
+		// hold the edge in place with a plane through it, square to the face
+		vec3 a = sim_pos(s, s.pos_of[s.tris[t * 3]]);
+		vec3 fn = cross(sim_pos(s, s.pos_of[s.tris[t * 3 + 1]]) - a, sim_pos(s, s.pos_of[s.tris[t * 3 + 2]]) - a);
+		vec3 e = sim_pos(s, pb) - sim_pos(s, pa);
+		vec3 bn = cross(e, fn);
+		float len = length(bn);
+		if (len <= 0.0f) {
+			continue;
+		}
+		bn = bn / len;
+		double w = dot(e, e) * SIMPLIFY_BORDER_WEIGHT;
+		add_plane(s.quadrics[pa], bn, -dot(bn, sim_pos(s, pa)), w);
+		add_plane(s.quadrics[pb], bn, -dot(bn, sim_pos(s, pa)), w);
+	}
+	std::sort(s.open_edges.begin(), s.open_edges.end());
+	s.open_edges.erase(std::unique(s.open_edges.begin(), s.open_edges.end()), s.open_edges.end());
+
+	// a position on exactly two open edges is part way along a line and can
+	// slide along it. one or more than two is an end or a junction
+	std::vector<int> open_count(vert_count, 0);
+	for (size_t i = 0; i < s.open_edges.size(); i++) {
+		open_count[(unsigned int)(s.open_edges[i] >> 32)]++;
+		open_count[(unsigned int)s.open_edges[i]]++;
+	}
+	s.kind.resize(vert_count);
+	for (size_t v = 0; v < vert_count; v++) {
+		s.kind[v] = (0 == open_count[v]) ? SIMPLIFY_FREE : (2 == open_count[v] ? SIMPLIFY_SLIDE : SIMPLIFY_LOCKED);
+	}
+
+	s.stamp.assign(vert_count, 0);
+	s.removed.assign(vert_count, 0);
+	std::vector<unsigned int> n_from, n_to;
+	for (size_t v = 0; v < vert_count; v++) {
+		if (s.pos_of[v] != v) {
+			continue;
+		}
+		sim_neighbours(s, (unsigned int)v, n_from);
+		for (size_t i = 0; i < n_from.size(); i++) {
+			sim_push(s, (unsigned int)v, n_from[i]);
+		}
+	}
+
+	size_t live_tris = tri_count;
+	double max_cost = 0.0;
+	std::vector<std::pair<unsigned int, unsigned int> > remap;
+	while (live_tris * 3 > target_index_count && !s.heap.empty()) {
+		collapse c = s.heap.top();
+		s.heap.pop();
+		unsigned int from = c.from, to = c.to;
+		if (s.removed[from] || s.removed[to] || s.stamp[from] != c.from_stamp || s.stamp[to] != c.to_stamp) {
+			continue;
+		}
+		if (!sim_collapse_ok(s, from, to, n_from, n_to)) {
+			continue;
+		}
+
+		// each vertex at from becomes the vertex at to that it shared an edge
+		// with in a removed triangle, so uvs and normals carry on across. ones
+		// with no such edge take whichever vertex at to has the nearest attributes
+		remap.clear();
+		for (unsigned int a = from; a != ~0u; a = s.next_twin[a]) {
+			unsigned int best = ~0u;
+			const std::vector<unsigned int>& vt = s.vert_tris[from];
+			for (size_t i = 0; i < vt.size() && ~0u == best; i++) {
+				const unsigned int* t = &s.tris[vt[i] * 3];
+				for (int k = 0; k < 3; k++) {
+					if (t[k] == a) {
+						for (int o = 1; o < 3; o++) {
+							if (s.pos_of[t[(k + o) % 3]] == to) {
+								best = t[(k + o) % 3];
+							}
+						}
+					}
+				}
+			}
+			if (~0u == best) {
+				float best_d = 1e30f;
+				for (unsigned int b = to; b != ~0u; b = s.next_twin[b]) {
+					vec3 dn = mesh.mNormals[a] - mesh.mNormals[b];
+					vec2 t_a = mesh.mTextureCoords[a], t_b = mesh.mTextureCoords[b];
+					float du = t_a.v[0] - t_b.v[0], dv = t_a.v[1] - t_b.v[1];
+					float d = dot(dn, dn) + du * du + dv * dv;
+					if (d < best_d) {
+						best_d = d;
+						best = b;
+					}
+				}
+			}
+			remap.push_back(std::make_pair(a, best));
+		}
+
+		std::vector<unsigned int>& from_tris = s.vert_tris[from];
+		for (size_t i = 0; i < from_tris.size(); i++) {
+			unsigned int t = from_tris[i];
+			unsigned int* corners = &s.tris[t * 3];
+			bool has_to = false;
+			for (int k = 0; k < 3; k++) {
+				has_to = has_to || s.pos_of[corners[k]] == to;
+			}
+			if (has_to) {
+				s.tri_dead[t] = 1;
+				live_tris--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				for (size_t r = 0; r < remap.size(); r++) {
+					if (corners[k] == remap[r].first) {
+						corners[k] = remap[r].second;
+						break;
+					}
+				}
+			}
+			s.vert_tris[to].push_back(t);
+		}
+		std::vector<unsigned int>().swap(from_tris);
+		add_quadric(s.quadrics[to], s.quadrics[from]);
+		s.removed[from] = 1;
+		s.stamp[to]++;
+		max_cost = c.cost > max_cost ? c.cost : max_cost;
+
+		sim_neighbours(s, to, n_to);
+		for (size_t i = 0; i < n_to.size(); i++) {
+			sim_push(s, to, n_to[i]);
+			sim_push(s, n_to[i], to);
+		}
+	}
+
+	out.clear();
+	out.reserve(live_tris * 3);
+	for (size_t t = 0; t < tri_count; t++) {
+		if (!s.tri_dead[t]) {
+			out.insert(out.end(), &s.tris[t * 3], &s.tris[t * 3] + 3);
+		}
+	}
+	error = (float)sqrt(max_cost);
+}
+
+// squared distance from p to the nearest point on triangle abc (Ericson,
+// Real-Time Collision Detection 5.1.5)
+static float point_triangle_distance2(const vec3& p, const vec3& a, const vec3& b, const vec3& c) {
+	vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = dot(ab, ap), d2 = dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		return length2(ap);
+	}
+	vec3 bp = p - b;
+	float d3 = dot(ab, bp), d4 = dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		return length2(bp);
+	}
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		return length2(ap - ab * (d1 / (d1 - d3)));
+	}
+	vec3 cp = p - c;
+	float d5 = dot(ab, cp), d6 = dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		return length2(cp);
+	}
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		return length2(ap - ac * (d2 / (d2 - d6)));
+	}
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+		return length2(bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+	}
+	float denom = va + vb + vc;
+	if (denom <= 0.0f) {
+		// squashed flat, so one of the edges is as near as anything
+		return std::min(length2(ap), std::min(length2(bp), length2(cp)));
+	}
+	vec3 q = a + ab * (vb / denom) + ac * (vc / denom);
+	return length2(p - q);
+}
+
+// the most cells on each axis of the grid lod_deviation sorts triangles into
+#define LOD_GRID_MAX_CELLS 128
+
+/* how far a level's triangles are from the full detail surface: the furthest
+any full detail vertex is from its nearest triangle. the triangles go in a grid
+of cells about a triangle across, and each vertex searches out a ring of cells
+at a time from its own until nothing further out could be nearer */
+static float lod_deviation(const ModelData& mesh, const std::vector<unsigned int>& indices) {
+	size_t tri_count = indices.size() / 3;
+	if (0 == tri_count) {
+		return 0.0f;
+	}
+	aabb bounds = aabb_from_points(mesh.mVertices.data(), (int)mesh.mPointCount);
+	vec3 extent = bounds.mx - bounds.mn;
+	// cells about a triangle across, so most searches end a ring or two out
+	double edge_sum = 0.0;
+	for (size_t t = 0; t < tri_count; t++) {
+		edge_sum += length(mesh.mVertices[indices[t * 3 + 1]] - mesh.mVertices[indices[t * 3]]);
+	}
+	float cell = (float)(edge_sum / tri_count);
+	cell = cell > 0.0f ? cell : 1.0f;
+	int dims[3];
+	float scale[3]; // cells per model unit
+	for (int k = 0; k < 3; k++) {
+		dims[k] = std::min(std::max((int)ceilf(extent.v[k] / cell), 1), LOD_GRID_MAX_CELLS);
+		scale[k] = extent.v[k] > 0.0f ? dims[k] / extent.v[k] : 0.0f;
+	}
+	auto cell_of = [&](const vec3& p, int k) {
+		int c = (int)((p.v[k] - bounds.mn.v[k]) * scale[k]);
+		return std::min(std::max(c, 0), dims[k] - 1);
+	};
+
+	// each triangle goes in every cell its bounds overlap, as offsets into one
+	// flat list like the other adjacency here
+	size_t cell_count = (size_t)dims[0] * dims[1] * dims[2];
+	std::vector<unsigned int> first_tri(cell_count + 1, 0);
+	std::vector<unsigned int> cell_tris;
+	for (int pass = 0; pass < 2; pass++) {
+		std::vector<unsigned int> fill(first_tri.begin(), first_tri.end() - 1);
+		for (size_t t = 0; t < tri_count; t++) {
+			int lo[3], hi[3];
+			for (int k = 0; k < 3; k++) {
+				lo[k] = hi[k] = cell_of(mesh.mVertices[indices[t * 3]], k);
+				for (int c = 1; c < 3; c++) {
+					int i = cell_of(mesh.mVertices[indices[t * 3 + c]], k);
+					lo[k] = std::min(lo[k], i);
+					hi[k] = std::max(hi[k], i);
+				}
+			}
+			for (int z = lo[2]; z <= hi[2]; z++) {
+				for (int y = lo[1]; y <= hi[1]; y++) {
+					for (int x = lo[0]; x <= hi[0]; x++) {
+						size_t i = ((size_t)z * dims[1] + y) * dims[0] + x;
+						if (0 == pass) {
+							first_tri[i + 1]++;
+						} else {
+							cell_tris[fill[i]++] = (unsigned int)t;
+						}
+					}
+				}
+			}
+		}
+		if (0 == pass) {
+			for (size_t i = 0; i < cell_count; i++) {
+				first_tri[i + 1] += first_tri[i];
+			}
+			cell_tris.resize(first_tri[cell_count]);
+		}
+	}
+
+	int max_ring = std::max(dims[0], std::max(dims[1], dims[2]));
+	float worst = 0.0f;
+	for (size_t v = 0; v < mesh.mPointCount; v++) {
+		const vec3& p = mesh.mVertices[v];
+		int at[3] = { cell_of(p, 0), cell_of(p, 1), cell_of(p, 2) };
+		float best = 1e30f;
+		for (int r = 0; r < max_ring; r++) {
+			// the cells r steps out (on the worst axis) from the vertex's own
+			for (int z = std::max(at[2] - r, 0); z <= std::min(at[2] + r, dims[2] - 1); z++) {
+				for (int y = std::max(at[1] - r, 0); y <= std::min(at[1] + r, dims[1] - 1); y++) {
+					for (int x = std::max(at[0] - r, 0); x <= std::min(at[0] + r, dims[0] - 1); x++) {
+						int steps = std::max(std::max(x - at[0], at[0] - x),
+							std::max(std::max(y - at[1], at[1] - y), std::max(z - at[2], at[2] - z)));
+						if (steps != r) {
+							continue;
+						}
+						size_t i = ((size_t)z * dims[1] + y) * dims[0] + x;
+						for (unsigned int j = first_tri[i]; j < first_tri[i + 1]; j++) {
+							const unsigned int* t = &indices[cell_tris[j] * 3];
+							float d = point_triangle_distance2(p, mesh.mVertices[t[0]], mesh.mVertices[t[1]],
+								mesh.mVertices[t[2]]);
+							best = d < best ? d : best;
+						}
+					}
+				}
+			}
+			// anything not searched yet is outside the box of cells so far
+			float beyond = 1e30f;
+			for (int k = 0; k < 3; k++) {
+				if (at[k] - r > 0) {
+					beyond = std::min(beyond, p.v[k] - (bounds.mn.v[k] + (at[k] - r) / scale[k]));
+				}
+				if (at[k] + r < dims[k] - 1) {
+					beyond = std::min(beyond, bounds.mn.v[k] + (at[k] + r + 1) / scale[k] - p.v[k]);
+				}
+			}
+			if (best <= beyond * beyond) {
+				break;
+			}
+		}
+		worst = best > worst ? best : worst;
+	}
+	return sqrtf(worst);
+}
+
+void build_lods(ModelData& mesh) {
+	mesh.mLods.clear();
+	for (int level = 1; level < MAX_MESH_LODS; level++) {
+		const std::vector<unsigned int>& prev = (1 == level) ? mesh.mIndices : mesh.mLods.back().indices;
+		mesh_lod lod;
+		float quadric_distance;
+		simplify_indices(mesh, prev, prev.size() / 2, lod.indices, quadric_distance);
+		// not worth a level if it barely shrank, and the next one won't do any better
+		if (lod.indices.size() * 4 > prev.size() * 3) {
+			break;
+		}
+		// each level is simplified from the one before, so it's measured against
+		// the full detail vertices rather than its own collapses
+		lod.error = lod_deviation(mesh, lod.indices);
+		// the cache optimiser only looks at the indices and the vertex count
+		ModelData order;
+		order.mPointCount = mesh.mPointCount;
+		order.mIndices.swap(lod.indices);
+		optimise_vertex_cache(order);
+		lod.indices.swap(order.mIndices);
+		printf("  LOD %i: %i triangles, error %g (quadric %g)\n", level, (int)lod.indices.size() / 3, lod.error,
+			quadric_distance);
+		mesh.mLods.push_back(lod);
+	}
+}
+
+/*-------------------------------------MESHLETS---------------------------------------*/
+
+// how much facing the same way counts against distance when growing a
+// meshlet, in average triangle sizes per unit of (1 - cos angle)
+#define MESHLET_CONE_WEIGHT 4.0f
+// past this the cone is too wide for the back face test to ever pass
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+static_assert(sizeof(meshlet) == 40, "meshlet layout changed, bump MESH_CACHE_VERSION");
+
+// bounding sphere and normal cone of the triangles tris[0..tri_count)
+static void meshlet_bounds(const ModelData& mesh, const unsigned int* tris, int tri_count, meshlet& m) {
+	std::vector<vec3> pts(tri_count * 3);
+	for (int i = 0; i < tri_count * 3; i++) {
+		pts[i] = mesh.mVertices[tris[i]];
+	}
+	m.bounds = sphere_from_points(pts.data(), (int)pts.size());
+
+	std::vector<vec3> normals(tri_count);
+	vec3 sum(0.0f, 0.0f, 0.0f);
+	for (int t = 0; t < tri_count; t++) {
+		vec3 n = cross(pts[t * 3 + 1] - pts[t * 3], pts[t * 3 + 2] - pts[t * 3]);
+		float len = length(n);
+		normals[t] = len > 0.0f ? n / len : vec3(0.0f, 0.0f, 0.0f);
+		sum = sum + normals[t];
+	}
+	float len = length(sum);
+	m.cone_axis = len > 0.0f ? sum / len : vec3(0.0f, 0.0f, 1.0f);
+	float min_dot = len > 0.0f ? 1.0f : -1.0f;
+	for (int t = 0; t < tri_count; t++) {
+		const vec3& n = normals[t];
+		// degenerate triangles can't be seen from either side
+		if (length2(n) > 0.0f) {
+			float d = dot(n, m.cone_axis);
+			min_dot = d < min_dot ? d : min_dot;
+		}
+	}
+	m.cone_cutoff = min_dot <= MESHLET_MIN_CONE_DOT ? 1.0f : sqrtf(1.0f - min_dot * min_dot);
+}
+
+void build_meshlets(ModelData& mesh) {
+	mesh.mMeshlets.clear();
+	const std::vector<unsigned int>& idx = mesh.mIndices;
+	size_t tri_count = idx.size() / 3;
+	if (0 == tri_count) {
+		return;
+	}
+	float acmr_before, atvr_before;
+	cache_stats(mesh, VERTEX_CACHE_SIZE, acmr_before, atvr_before);
+
+	// which triangles use each vertex
+	std::vector<unsigned int> first_tri(mesh.mPointCount + 1, 0);
+	for (size_t i = 0; i < idx.size(); i++) {
+		first_tri[idx[i] + 1]++;
+	}
+	for (size_t v = 0; v < mesh.mPointCount; v++) {
+		first_tri[v + 1] += first_tri[v];
+	}
+	std::vector<unsigned int> vert_tris(idx.size());
+	std::vector<unsigned int> fill(first_tri.begin(), first_tri.end() - 1);
+	for (size_t i = 0; i < idx.size(); i++) {
+		vert_tris[fill[idx[i]]++] = (unsigned int)(i / 3);
+	}
+
+	// unit face normals and centres, and the average triangle size to scale
+	// the facing term against distance
+	std::vector<vec3> face_normals(tri_count);
+	std::vector<vec3> centres(tri_count);
+	double edge_sum = 0.0;
+	for (size_t t = 0; t < tri_count; t++) {
+		const vec3& a = mesh.mVertices[idx[t * 3]];
+		const vec3& b = mesh.mVertices[idx[t * 3 + 1]];
+		const vec3& c = mesh.mVertices[idx[t * 3 + 2]];
+		vec3 n = cross(b - a, c - a);
+		float len = length(n);
+		face_normals[t] = len > 0.0f ? n / len : vec3(0.0f, 0.0f, 0.0f);
+		centres[t] = (a + b + c) / 3.0f;
+		edge_sum += length(b - a);
+	}
+	float tri_size = (float)(edge_sum / tri_count);
+	tri_size = tri_size > 0.0f ? tri_size : 1.0f;
+
+	std::vector<unsigned char> used(tri_count, 0);
+	std::vector<int> slot(mesh.mPointCount, -1); // in the current meshlet, or -1
+	std::vector<unsigned int> verts; // the current meshlet's vertices
+	std::vector<unsigned int> candidates; // triangles touching it, some used by now
+	std::vector<unsigned int> order; // the new triangle order
+	order.reserve(tri_count);
+	size_t seed = 0;
+	while (order.size() < tri_count) {
+		while (used[seed]) {
+			seed++;
+		}
+		size_t first = order.size();
+		vec3 centre_sum(0.0f, 0.0f, 0.0f);
+		vec3 normal_sum(0.0f, 0.0f, 0.0f);
+		unsigned int t = (unsigned int)seed;
+		for (;;) {
+			used[t] = 1;
+			order.push_back(t);
+			centre_sum = centre_sum + centres[t];
+			normal_sum = normal_sum + face_normals[t];
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = idx[t * 3 + c];
+				if (slot[v] >= 0) {
+					continue;
+				}
+				slot[v] = (int)verts.size();
+				verts.push_back(v);
+				for (unsigned int j = first_tri[v]; j < first_tri[v + 1]; j++) {
+					if (!used[vert_tris[j]]) {
+						candidates.push_back(vert_tris[j]);
+					}
+				}
+			}
+			int tris_in = (int)(order.size() - first);
+			if (tris_in >= MESHLET_MAX_TRIANGLES) {
+				break;
+			}
+
+			// the next triangle: fewest new vertices, then nearest and best facing
+			vec3 centre = centre_sum / (float)tris_in;
+			float normal_len = length(normal_sum);
+			vec3 axis = normal_len > 0.0f ? normal_sum / normal_len : vec3(0.0f, 0.0f, 0.0f);
+			int best = -1;
+			int best_new = 4;
+			float best_score = 0.0f;
+			size_t kept = 0;
+			for (size_t i = 0; i < candidates.size(); i++) {
+				unsigned int c = candidates[i];
+				if (used[c]) {
+					continue;
+				}
+				candidates[kept++] = c;
+				int new_verts = (slot[idx[c * 3]] < 0) + (slot[idx[c * 3 + 1]] < 0) + (slot[idx[c * 3 + 2]] < 0);
+				if (verts.size() + new_verts > MESHLET_MAX_VERTICES || new_verts > best_new) {
+					continue;
+				}
+				float score = length(centres[c] - centre) +
+					MESHLET_CONE_WEIGHT * tri_size * (1.0f - dot(face_normals[c], axis));
+				if (new_verts < best_new || score < best_score) {
+					best = (int)c;
+					best_new = new_verts;
+					best_score = score;
+				}
+			}
+			candidates.resize(kept);
+			// nothing touching fits (or it's an island that's all used up), so
+			// start a new meshlet rather than jump somewhere far away
+			if (best < 0) {
+				break;
+			}
+			t = (unsigned int)best;
+		}
+
+		meshlet m;
+		m.first_index = (unsigned int)first * 3;
+		m.index_count = (unsigned int)(order.size() - first) * 3;
+		mesh.mMeshlets.push_back(m);
+		for (size_t i = 0; i < verts.size(); i++) {
+			slot[verts[i]] = -1;
+		}
+		verts.clear();
+		candidates.clear();
+	}
+
+	std::vector<unsigned int> reordered(idx.size());
+	for (size_t i = 0; i < tri_count; i++) {
+		memcpy(&reordered[i * 3], &idx[order[i] * 3], 3 * sizeof(unsigned int));
+	}
+	mesh.mIndices.swap(reordered);
+
+	// growing from seeds in turn loses optimise_overdraw's cluster order, so
+	// sort the meshlets the same way, as the clusters they now are
+	std::vector<int> starts(mesh.mMeshlets.size());
+	for (size_t i = 0; i < mesh.mMeshlets.size(); i++) {
+		starts[i] = (int)(mesh.mMeshlets[i].first_index / 3);
+	}
+	std::vector<int> meshlet_order;
+	occlusion_order(mesh, starts, meshlet_order);
+	std::vector<meshlet> sorted(mesh.mMeshlets.size());
+	unsigned int at = 0;
+	for (size_t i = 0; i < meshlet_order.size(); i++) {
+		const meshlet& m = mesh.mMeshlets[meshlet_order[i]];
+		memcpy(&reordered[at], &mesh.mIndices[m.first_index], m.index_count * sizeof(unsigned int));
+		sorted[i] = m;
+		sorted[i].first_index = at;
+		at += m.index_count;
+	}
+	mesh.mIndices.swap(reordered);
+	mesh.mMeshlets.swap(sorted);
+
+	// the growth order wanders, so put each meshlet back in cache order. done on
+	// local vertex numbers, so the optimiser's per-vertex arrays stay small
+	ModelData local;
+	for (size_t i = 0; i < mesh.mMeshlets.size(); i++) {
+		const meshlet& m = mesh.mMeshlets[i];
+		unsigned int* tris = &mesh.mIndices[m.first_index];
+		verts.clear();
+		local.mIndices.resize(m.index_count);
+		for (unsigned int j = 0; j < m.index_count; j++) {
+			if (slot[tris[j]] < 0) {
+				slot[tris[j]] = (int)verts.size();
+				verts.push_back(tris[j]);
+			}
+			local.mIndices[j] = slot[tris[j]];
+		}
+		local.mPointCount = verts.size();
+		optimise_vertex_cache(local);
+		for (unsigned int j = 0; j < m.index_count; j++) {
+			tris[j] = verts[local.mIndices[j]];
+		}
+		for (size_t j = 0; j < verts.size(); j++) {
+			slot[verts[j]] = -1;
+		}
+	}
+
+	int coned = 0;
+	for (size_t i = 0; i < mesh.mMeshlets.size(); i++) {
+		meshlet& m = mesh.mMeshlets[i];
+		meshlet_bounds(mesh, &mesh.mIndices[m.first_index], m.index_count / 3, m);
+		coned += m.cone_cutoff < 1.0f;
+	}
+	float acmr, atvr;
+	cache_stats(mesh, VERTEX_CACHE_SIZE, acmr, atvr);
+	printf("  %i meshlets, %.1f triangles each, %.0f%% with a usable cone, ACMR %.3f -> %.3f\n",
+		(int)mesh.mMeshlets.size(), (float)tri_count / mesh.mMeshlets.size(),
+		100.0f * coned / mesh.mMeshlets.size(), acmr_before, acmr);
+}
+
+// does a meshlet face away from the eye?
+static bool meshlet_faces_away(const meshlet& m, const vec3& eye) {
+	vec3 d = m.bounds.centre - eye;
+	return dot(d, m.cone_axis) >= m.cone_cutoff * length(d) + m.bounds.radius;
+}
+
+int cull_meshlets(const meshlet* meshlets, int count, const frustum& f, const vec3& eye, bool test_cones,
+	unsigned char* visible) {
+	int tris = 0;
+	for (int i = 0; i < count; i++) {
+		const meshlet& m = meshlets[i];
+		bool keep = !(test_cones && meshlet_faces_away(m, eye)) && classify(f, m.bounds) != CULL_OUTSIDE;
+		visible[i] = keep;
+		tris += keep ? m.index_count / 3 : 0;
+	}
+	return tris;
+}
+
+static void cull_meshlets_chunk(const meshlet* meshlets, int count, const frustum* f, const vec3* eye,
+	bool test_cones, unsigned char* visible, int* tris) {
+	*tris = cull_meshlets(meshlets, count, *f, *eye, test_cones, visible);
+}
+
+int cull_meshlets_mt(const meshlet* meshlets, int count, const frustum& f, const vec3& eye, bool test_cones,
+	unsigned char* visible, int num_threads) {
+	// below this many meshlets per thread the thread start-up costs more than it saves
+	const int min_per_thread = 4096;
+	if (num_threads <= 0) {
+		num_threads = (int)std::thread::hardware_concurrency();
+	}
+	if (num_threads > count / min_per_thread) {
+		num_threads = count / min_per_thread;
+	}
+	if (num_threads <= 1) {
+		return cull_meshlets(meshlets, count, f, eye, test_cones, visible);
+	}
+	int chunk = (count + num_threads - 1) / num_threads;
+	std::vector<int> tris(num_threads, 0);
+	std::vector<std::thread> workers;
+	for (int t = 1; t < num_threads; t++) {
+		int first = t * chunk;
+		int n = (first + chunk > count) ? count - first : chunk;
+		workers.push_back(std::thread(cull_meshlets_chunk, meshlets + first, n, &f, &eye, test_cones,
+			visible + first, &tris[t]));
+	}
+	// the calling thread does the first chunk itself
+	tris[0] = cull_meshlets(meshlets, chunk, f, eye, test_cones, visible);
+	int total = 0;
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	for (int t = 0; t < num_threads; t++) {
+		total += tris[t];
+	}
+	return total;
+}
+
+void meshlet_cull_report(const meshlet* meshlets, int count, const aabb& bounds) {
+	if (0 == count) {
+		return;
+	}
+	vec3 centre = (bounds.mn + bounds.mx) * 0.5f;
+	float radius = length(bounds.mx - bounds.mn) * 0.5f;
+	radius = radius > 0.0f ? radius : 1.0f;
+	int total = 0;
+	for (int i = 0; i < count; i++) {
+		total += meshlets[i].index_count / 3;
+	}
+	// the same projection as the demo camera
+	mat4 proj = perspective(45.0f, 4.0f / 3.0f, 0.1f * radius, 100.0f * radius);
+	std::vector<unsigned char> visible(count);
+	std::vector<unsigned char> in_view(count);
+	printf("  meshlet culling, %i meshlets, %i triangles\n", count, total);
+	printf("    distance  angle  off screen  facing away  drawn   cull time\n");
+	const float distances[] = { 0.6f, 1.5f, 4.0f };
+	double culled_sum = 0.0;
+	int views = 0;
+	for (int d = 0; d < 3; d++) {
+		for (int a = 0; a < 360; a += 45) {
+			// orbit level with the middle, looking in. the nearest ring is
+			// inside the bounds, so most of the mesh is off screen
+			float rad = a * ONE_DEG_IN_RAD;
+			vec3 eye = centre + vec3(sinf(rad), 0.25f, cosf(rad)) * (distances[d] * radius);
+			frustum f = extract_frustum(proj * look_at(eye, centre, vec3(0.0f, 1.0f, 0.0f)));
+			int in_view_tris = 0;
+			for (int i = 0; i < count; i++) {
+				in_view[i] = classify(f, meshlets[i].bounds) != CULL_OUTSIDE;
+				in_view_tris += in_view[i] ? meshlets[i].index_count / 3 : 0;
+			}
+			const int runs = 20;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			int drawn = 0;
+			for (int r = 0; r < runs; r++) {
+				drawn = cull_meshlets_mt(meshlets, count, f, eye, true, visible.data());
+			}
+			double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / runs;
+			printf("    %7.1fr  %5i  %9.1f%%  %10.1f%%  %5.1f%%  %7.1f us\n", distances[d], a,
+				100.0 * (total - in_view_tris) / total, 100.0 * (in_view_tris - drawn) / total,
+				100.0 * drawn / total, us);
+			culled_sum += 100.0 * (total - drawn) / total;
+			views++;
+		}
+	}
+	printf("    average %.1f%% of triangles culled\n", culled_sum / views);
+}
+
+/*---------------------------------BINARY MESH CACHE----------------------------------*/
+
+/* <source>.cache holds the mesh the way the GL buffers want it, so it can be
+uploaded straight out of the mapping:
+header    | 128 bytes
+vertices  | all the positions, then all the normals, then all the uvs, then
+          | all the tangents, as floats or quantised (see vertex_format in
+          | mesh_funcs.h)
+indices   | 16 or 32 bit, starting on a 16 byte boundary. every level of
+          | detail back to back, finest first, as listed in the header
+meshlets  | level 0's meshlets, starting on a 16 byte boundary
+checksum covers everything after the header */
+struct mesh_cache_header {
+	char magic[4];
+	unsigned int version;
+	long long source_mtime;
+	long long source_size;
+	unsigned int vertex_count;
+	unsigned int index_count;
+	aabb bounds;
+	unsigned int index_size;
+	unsigned int checksum;
+	unsigned int vertex_format;
+	unsigned int lod_count;
+	mesh_lod_range lods[MAX_MESH_LODS];
+	unsigned int meshlet_count;
+	unsigned int import_profile; // what the mesh was imported with, see mesh_funcs.h
+};
+static_assert(sizeof(mesh_cache_header) == 128, "mesh cache header layout changed, bump MESH_CACHE_VERSION");
+
+static const char mesh_cache_magic[4] = { 'M', 'S', 'H', 'C' };
+
+static std::string cache_name(const char* source_name) {
+	return std::string(source_name) + ".cache";
+}
+
+// bytes per vertex of each attribute
+static size_t position_bytes(int vertex_format) {
+	return (VERTEX_QUANTISED == vertex_format) ? 4 * sizeof(unsigned short) : sizeof(vec3);
+}
+
+static size_t normal_bytes(int vertex_format) {
+	return (VERTEX_QUANTISED == vertex_format) ? 2 * sizeof(short) : sizeof(vec3);
+}
+
+static size_t uv_bytes(int vertex_format) {
+	return (VERTEX_QUANTISED == vertex_format) ? 2 * sizeof(unsigned short) : sizeof(vec2);
+}
+
+static size_t tangent_bytes(int vertex_format) {
+	return (VERTEX_QUANTISED == vertex_format) ? 2 * sizeof(short) : sizeof(vec4);
+}
+
+static size_t cache_vertex_bytes(size_t vertex_count, int vertex_format) {
+	return vertex_count * (position_bytes(vertex_format) + normal_bytes(vertex_format) + uv_bytes(vertex_format) +
+		tangent_bytes(vertex_format));
+}
+
+static size_t cache_index_offset(size_t vertex_count, int vertex_format) {
+	return (sizeof(mesh_cache_header) + cache_vertex_bytes(vertex_count, vertex_format) + 15) & ~(size_t)15;
+}
+
+static size_t cache_meshlet_offset(const mesh_cache_header& h) {
+	return (cache_index_offset(h.vertex_count, h.vertex_format) + (size_t)h.index_count * h.index_size + 15) &
+		~(size_t)15;
+}
+
+static size_t cache_size(const mesh_cache_header& h) {
+	return cache_meshlet_offset(h) + h.meshlet_count * sizeof(meshlet);
+}
+
+/*--------------------------------VERTEX QUANTISATION---------------------------------*/
+
+// the worst any vertex came out after a round trip through the quantised format
+struct quantise_error {
+	float position; // model units
+	float normal_deg;
+	float uv;
+	float tangent_deg;
+};
+
+// positions go to 16-bit unorm across the bounds, so the shader gets them back
+// as bounds.mn + v * (bounds.mx - bounds.mn)
+static void quantise_positions(const ModelData& mesh, unsigned short* out, float& max_err) {
+	vec3 mn = mesh.mBounds.mn;
+	vec3 extent = mesh.mBounds.mx - mesh.mBounds.mn;
+	max_err = 0.0f;
+	for (size_t i = 0; i < mesh.mPointCount; i++) {
+		for (int k = 0; k < 3; k++) {
+			float t = (extent.v[k] > 0.0f) ? (mesh.mVertices[i].v[k] - mn.v[k]) / extent.v[k] : 0.0f;
+			t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+			unsigned short q = (unsigned short)(t * 65535.0f + 0.5f);
+			out[i * 4 + k] = q;
+			float err = fabsf(mn.v[k] + (q / 65535.0f) * extent.v[k] - mesh.mVertices[i].v[k]);
+			max_err = err > max_err ? err : max_err;
+		}
+		// the tangent's sign fills out the 8 bytes
+		bool flipped = i < mesh.mTangents.size() && mesh.mTangents[i].v[3] < 0.0f;
+		out[i * 4 + 3] = flipped ? 0 : 65535;
+	}
+}
+
+// round trip error of an octahedral encoded unit vector, as a chord length.
+// the angle comes from the chord since acos of a dot this close to 1 is all
+// float rounding. zero vectors (normals from files without any) have nothing
+// to lose
+static float oct_error(const vec3& v, const short* code) {
+	if (dot(v, v) <= 0.0f) {
+		return 0.0f;
+	}
+	return length(oct_decode(code[0], code[1]) - v);
+}
+
+static float chord_to_deg(float chord) {
+	return 2.0f * asinf(chord > 2.0f ? 1.0f : 0.5f * chord) * ONE_RAD_IN_DEG;
+}
+
+static void quantise_vertices(const ModelData& mesh, char* out, quantise_error& err) {
+	size_t n = mesh.mPointCount;
+	unsigned short* positions = (unsigned short*)out;
+	short* normals = (short*)(out + n * position_bytes(VERTEX_QUANTISED));
+	unsigned short* uvs = (unsigned short*)(out + n * (position_bytes(VERTEX_QUANTISED) + normal_bytes(VERTEX_QUANTISED)));
+	short* tangents = (short*)(out + n * (position_bytes(VERTEX_QUANTISED) + normal_bytes(VERTEX_QUANTISED) +
+		uv_bytes(VERTEX_QUANTISED)));
+	bool has_tangents = mesh.mTangents.size() == n;
+	quantise_positions(mesh, positions, err.position);
+	float max_dist = 0.0f;
+	float max_tangent_dist = 0.0f;
+	err.uv = 0.0f;
+	for (size_t i = 0; i < n; i++) {
+		oct_encode(mesh.mNormals[i], normals + i * 2);
+		float d = oct_error(mesh.mNormals[i], normals + i * 2);
+		max_dist = d > max_dist ? d : max_dist;
+		vec3 t = has_tangents ? vec3(mesh.mTangents[i].v[0], mesh.mTangents[i].v[1], mesh.mTangents[i].v[2]) :
+			vec3(0.0f, 0.0f, 0.0f);
+		oct_encode(t, tangents + i * 2);
+		d = oct_error(t, tangents + i * 2);
+		max_tangent_dist = d > max_tangent_dist ? d : max_tangent_dist;
+		for (int k = 0; k < 2; k++) {
+			uvs[i * 2 + k] = float_to_half(mesh.mTextureCoords[i].v[k]);
+			float e = fabsf(half_to_float(uvs[i * 2 + k]) - mesh.mTextureCoords[i].v[k]);
+			err.uv = e > err.uv ? e : err.uv;
+		}
+	}
+	err.normal_deg = chord_to_deg(max_dist);
+	err.tangent_deg = chord_to_deg(max_tangent_dist);
+}
+
+static void dequantise_vertices(const char* in, size_t n, const aabb& bounds, ModelData& out) {
+	const unsigned short* positions = (const unsigned short*)in;
+	const short* normals = (const short*)(in + n * position_bytes(VERTEX_QUANTISED));
+	const unsigned short* uvs = (const unsigned short*)(in + n * (position_bytes(VERTEX_QUANTISED) + normal_bytes(VERTEX_QUANTISED)));
+	const short* tangents = (const short*)(in + n * (position_bytes(VERTEX_QUANTISED) + normal_bytes(VERTEX_QUANTISED) +
+		uv_bytes(VERTEX_QUANTISED)));
+	vec3 extent = bounds.mx - bounds.mn;
+	out.mVertices.resize(n);
+	out.mNormals.resize(n);
+	out.mTextureCoords.resize(n);
+	out.mTangents.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		for (int k = 0; k < 3; k++) {
+			out.mVertices[i].v[k] = bounds.mn.v[k] + (positions[i * 4 + k] / 65535.0f) * extent.v[k];
+		}
+		out.mNormals[i] = oct_decode(normals[i * 2], normals[i * 2 + 1]);
+		out.mTextureCoords[i] = vec2(half_to_float(uvs[i * 2]), half_to_float(uvs[i * 2 + 1]));
+		out.mTangents[i] = vec4(oct_decode(tangents[i * 2], tangents[i * 2 + 1]), positions[i * 4 + 3] ? 1.0f : -1.0f);
+	}
+}
+
+/*---------------------------------CACHE READ/WRITE-----------------------------------*/
+
+// the whole file in memory, stamped with the source's modification time and size
+// in MESH_VERTEX_FORMAT. err gets the quantisation error, if it's given and
+// the format is quantised
+static void fill_cache_image(const ModelData& mesh, long long source_mtime, long long source_size,
+	std::vector<char>& buf, quantise_error* err = NULL) {
+	// value initialised, so the padding is zeroed too
+	mesh_cache_header h = mesh_cache_header();
+	h.source_mtime = source_mtime;
+	h.source_size = source_size;
+	memcpy(h.magic, mesh_cache_magic, 4);
+	h.version = MESH_CACHE_VERSION;
+	h.vertex_count = (unsigned int)mesh.mPointCount;
+	h.bounds = mesh.mBounds;
+	h.index_size = needs_32bit_indices(mesh) ? 4 : 2;
+	h.vertex_format = MESH_VERTEX_FORMAT;
+	const std::vector<unsigned int>* levels[MAX_MESH_LODS];
+	levels[0] = &mesh.mIndices;
+	h.lod_count = 1;
+	for (size_t i = 0; i < mesh.mLods.size() && h.lod_count < MAX_MESH_LODS; i++) {
+		h.lods[h.lod_count].error = mesh.mLods[i].error;
+		levels[h.lod_count++] = &mesh.mLods[i].indices;
+	}
+	for (unsigned int l = 0; l < h.lod_count; l++) {
+		h.lods[l].first_index = h.index_count;
+		h.lods[l].index_count = (unsigned int)levels[l]->size();
+		h.index_count += h.lods[l].index_count;
+	}
+	h.meshlet_count = (unsigned int)mesh.mMeshlets.size();
+	h.import_profile = (unsigned int)get_import_profile();
+
+	size_t index_offset = cache_index_offset(h.vertex_count, h.vertex_format);
+	buf.assign(cache_size(h), 0);
+	char* p = buf.data() + sizeof(h);
+	if (VERTEX_QUANTISED == h.vertex_format) {
+		quantise_error e;
+		quantise_vertices(mesh, p, e);
+		if (err) {
+			*err = e;
+		}
+	} else {
+		memcpy(p, mesh.mVertices.data(), h.vertex_count * sizeof(vec3));
+		p += h.vertex_count * sizeof(vec3);
+		memcpy(p, mesh.mNormals.data(), h.vertex_count * sizeof(vec3));
+		p += h.vertex_count * sizeof(vec3);
+		memcpy(p, mesh.mTextureCoords.data(), h.vertex_count * sizeof(vec2));
+		p += h.vertex_count * sizeof(vec2);
+		// a mesh without tangents leaves them zeroed
+		if (mesh.mTangents.size() == h.vertex_count) {
+			memcpy(p, mesh.mTangents.data(), h.vertex_count * sizeof(vec4));
+		}
+	}
+	for (unsigned int l = 0; l < h.lod_count; l++) {
+		const std::vector<unsigned int>& idx = *levels[l];
+		char* dst = buf.data() + index_offset + (size_t)h.lods[l].first_index * h.index_size;
+		if (4 == h.index_size) {
+			memcpy(dst, idx.data(), idx.size() * sizeof(unsigned int));
+		} else {
+			// index_offset is 16 byte aligned, so this is too
+			unsigned short* dst16 = (unsigned short*)dst;
+			for (size_t i = 0; i < idx.size(); i++) {
+				dst16[i] = (unsigned short)idx[i];
+			}
+		}
+	}
+	if (h.meshlet_count > 0) {
+		memcpy(buf.data() + cache_meshlet_offset(h), mesh.mMeshlets.data(), h.meshlet_count * sizeof(meshlet));
+	}
+	h.checksum = checksum32(buf.data() + sizeof(h), buf.size() - sizeof(h));
+	memcpy(buf.data(), &h, sizeof(h));
+}
+
+// the whole file in memory, ready to write out
+static bool build_cache_image(const char* source_name, const ModelData& mesh, std::vector<char>& buf) {
+	long long mtime, size;
+	if (!file_stamp(source_name, mtime, size)) {
+		return false;
+	}
+	quantise_error err;
+	fill_cache_image(mesh, mtime, size, buf, &err);
+	if (VERTEX_QUANTISED == MESH_VERTEX_FORMAT) {
+		// what quantising cost against the float layout. every vertex fetch
+		// reads half as much, as well as the buffer being half the size
+		vec3 extent = mesh.mBounds.mx - mesh.mBounds.mn;
+		float size_max = extent.v[0] > extent.v[1] ? extent.v[0] : extent.v[1];
+		size_max = extent.v[2] > size_max ? extent.v[2] : size_max;
+		printf("  quantised vertices %i -> %i bytes (%.1f KB -> %.1f KB of vertex buffer)\n",
+			(int)cache_vertex_bytes(1, VERTEX_FLOAT), (int)cache_vertex_bytes(1, VERTEX_QUANTISED),
+			cache_vertex_bytes(mesh.mPointCount, VERTEX_FLOAT) / 1024.0,
+			cache_vertex_bytes(mesh.mPointCount, VERTEX_QUANTISED) / 1024.0);
+		printf("  worst error: position %g (%.5f%% of the mesh size), normal %.4f deg, tangent %.4f deg, uv %g\n",
+			err.position, size_max > 0.0f ? 100.0f * err.position / size_max : 0.0f, err.normal_deg,
+			err.tangent_deg, err.uv);
+	}
+	return true;
+}
+
+// is this a whole, well formed image of the current version? says nothing
+// about what it was made from
+static bool check_cache_layout(const char* base, size_t size, mesh_cache_header& h) {
+	if (size < sizeof(h)) {
+		return false;
+	}
+	memcpy(&h, base, sizeof(h));
+	if (h.lod_count < 1 || h.lod_count > MAX_MESH_LODS) {
+		return false;
+	}
+	for (unsigned int l = 0; l < h.lod_count; l++) {
+		if (h.lods[l].first_index > h.index_count || h.lods[l].index_count > h.index_count - h.lods[l].first_index) {
+			return false;
+		}
+	}
+	return 0 == memcmp(h.magic, mesh_cache_magic, 4) && MESH_CACHE_VERSION == h.version &&
+		(2 == h.index_size || 4 == h.index_size) &&
+		(VERTEX_FLOAT == h.vertex_format || VERTEX_QUANTISED == h.vertex_format) &&
+		h.meshlet_count <= h.lods[0].index_count / 3 && size == cache_size(h);
+}
+
+// is this a cache for the source as it is now? the checksum is optional because
+// checking it reads the whole file, which the zero-copy path wants to avoid
+static bool check_cache_image(const char* source_name, const char* base, size_t size,
+	bool verify_checksum, mesh_cache_header& h) {
+	long long mtime, fsize;
+	if (!file_stamp(source_name, mtime, fsize) || !check_cache_layout(base, size, h)) {
+		return false;
+	}
+	return mtime == h.source_mtime && fsize == h.source_size &&
+		(unsigned int)get_import_profile() == h.import_profile &&
+		(!verify_checksum || h.checksum == checksum32(base + sizeof(h), size - sizeof(h)));
+}
+
+bool load_mesh_cache(const char* source_name, ModelData& out) {
+	std::string path = cache_name(source_name);
+	mapped_file mf;
+	if (!map_file(path.c_str(), mf)) {
+		return false;
+	}
+	const char* base = (const char*)mf.data;
+	mesh_cache_header h;
+	if (!check_cache_image(source_name, base, mf.size, true, h)) {
+		printf("  mesh cache %s is stale, damaged or from the other import profile, reimporting\n", path.c_str());
+		unmap_file(mf);
+		return false;
+	}
+
+	const char* p = base + sizeof(h);
+	out.mPointCount = h.vertex_count;
+	if (VERTEX_QUANTISED == h.vertex_format) {
+		dequantise_vertices(p, h.vertex_count, h.bounds, out);
+	} else {
+		out.mVertices.assign((const vec3*)p, (const vec3*)p + h.vertex_count);
+		p += h.vertex_count * sizeof(vec3);
+		out.mNormals.assign((const vec3*)p, (const vec3*)p + h.vertex_count);
+		p += h.vertex_count * sizeof(vec3);
+		out.mTextureCoords.assign((const vec2*)p, (const vec2*)p + h.vertex_count);
+		p += h.vertex_count * sizeof(vec2);
+		out.mTangents.assign((const vec4*)p, (const vec4*)p + h.vertex_count);
+	}
+	p = base + cache_index_offset(h.vertex_count, h.vertex_format);
+	out.mLods.resize(h.lod_count - 1);
+	for (unsigned int l = 0; l < h.lod_count; l++) {
+		std::vector<unsigned int>& idx = (0 == l) ? out.mIndices : out.mLods[l - 1].indices;
+		const char* src = p + (size_t)h.lods[l].first_index * h.index_size;
+		if (4 == h.index_size) {
+			idx.assign((const unsigned int*)src, (const unsigned int*)src + h.lods[l].index_count);
+		} else {
+			idx.assign((const unsigned short*)src, (const unsigned short*)src + h.lods[l].index_count);
+		}
+		if (l > 0) {
+			out.mLods[l - 1].error = h.lods[l].error;
+		}
+	}
+	const meshlet* m = (const meshlet*)(base + cache_meshlet_offset(h));
+	out.mMeshlets.assign(m, m + h.meshlet_count);
+	out.mBounds = h.bounds;
+	unmap_file(mf);
+	return true;
+}
+
+bool save_mesh_cache(const char* source_name, const ModelData& mesh) {
+	std::vector<char> buf;
+	if (!build_cache_image(source_name, mesh, buf)) {
+		return false;
+	}
+	return write_file_atomic(cache_name(source_name).c_str(), buf.data(), buf.size());
+}
+
+// point a mesh_mapping at a checked cache image, wherever its bytes live
+static void set_mapping(const char* base, const mesh_cache_header& h, mesh_mapping& mm) {
+	mm.vertex_count = h.vertex_count;
+	mm.index_count = h.index_count;
+	mm.index_size = h.index_size;
+	mm.lod_count = h.lod_count;
+	for (unsigned int l = 0; l < h.lod_count; l++) {
+		mm.lods[l] = h.lods[l];
+	}
+	mm.bounds = h.bounds;
+	mm.vertex_format = h.vertex_format;
+	if (VERTEX_QUANTISED == h.vertex_format) {
+		mm.position_offset = h.bounds.mn;
+		mm.position_scale = h.bounds.mx - h.bounds.mn;
+	} else {
+		mm.position_offset = vec3(0.0f, 0.0f, 0.0f);
+		mm.position_scale = vec3(1.0f, 1.0f, 1.0f);
+	}
+	mm.vertex_data = base + sizeof(h);
+	mm.vertex_bytes = cache_vertex_bytes(h.vertex_count, h.vertex_format);
+	mm.normal_offset = h.vertex_count * position_bytes(h.vertex_format);
+	mm.uv_offset = mm.normal_offset + h.vertex_count * normal_bytes(h.vertex_format);
+	mm.tangent_offset = mm.uv_offset + h.vertex_count * uv_bytes(h.vertex_format);
+	mm.index_data = base + cache_index_offset(h.vertex_count, h.vertex_format);
+	mm.index_bytes = (size_t)h.index_count * h.index_size;
+	mm.meshlets = (const meshlet*)(base + cache_meshlet_offset(h));
+	mm.meshlet_count = h.meshlet_count;
+}
+
+/*----------------------------------IMPORT PROFILES-----------------------------------*/
+
+static int current_import_profile = DEFAULT_IMPORT_PROFILE;
+
+static const char* import_profile_names[IMPORT_PROFILE_COUNT] = { "fast", "quality" };
+
+void set_import_profile(int profile) {
+	if (profile < 0 || profile >= IMPORT_PROFILE_COUNT) {
+		fprintf(stderr, "WARNING. no import profile %i, keeping %s\n", profile,
+			import_profile_names[current_import_profile]);
+		return;
+	}
+	current_import_profile = profile;
+}
+
+int get_import_profile() {
+	return current_import_profile;
+}
+
+const char* import_profile_name(int profile) {
+	return (profile >= 0 && profile < IMPORT_PROFILE_COUNT) ? import_profile_names[profile] : "unknown";
+}
+
+bool parse_import_profile(const char* name, int& profile) {
+	for (int i = 0; i < IMPORT_PROFILE_COUNT; i++) {
+		if (0 == strcmp(name, import_profile_names[i])) {
+			profile = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// the post-processing steps we use, in the order of assimp's step registry,
+// which is the order it runs them in when they're all passed to aiImportFile
+// at once. so running them one at a time comes out the same
+struct import_step {
+	unsigned int flag;
+	const char* name;
+};
+static const import_step import_steps[] = {
+	{ aiProcess_OptimizeGraph, "optimise graph" },
+	{ aiProcess_OptimizeMeshes, "optimise meshes" },
+	{ aiProcess_PreTransformVertices, "pretransform" },
+	{ aiProcess_Triangulate, "triangulate" },
+	{ aiProcess_GenSmoothNormals, "smooth normals" },
+	{ aiProcess_JoinIdenticalVertices, "join vertices" },
+	{ aiProcess_ImproveCacheLocality, "cache locality" },
+};
+
+// assimp flags for a profile. assimp won't run OptimizeGraph and
+// PreTransformVertices together, so flattening takes the place of the graph step
+static unsigned int import_profile_flags(int profile, bool pretransform) {
+	unsigned int flags = aiProcess_Triangulate;
+	if (IMPORT_QUALITY == profile) {
+		flags |= aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality | aiProcess_OptimizeMeshes |
+			aiProcess_GenSmoothNormals;
+		if (!pretransform) {
+			flags |= aiProcess_OptimizeGraph;
+		}
+	}
+	if (pretransform) {
+		flags |= aiProcess_PreTransformVertices;
+	}
+	return flags;
+}
+
+/* wall time of each stage of an import, printed together at the end as
+	import stages (fast): read 12.3, pretransform 0.4, triangulate 1.2, ... = 140.2 ms
+so it's easy to see where a slow load goes and what a profile costs */
+struct stage_timer {
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point last;
+	std::string stages;
+};
+
+static void stage_begin(stage_timer& t) {
+	t.start = t.last = std::chrono::steady_clock::now();
+	t.stages.clear();
+}
+
+// the time since the last stage ended goes down as this one
+static void stage_end(stage_timer& t, const char* name) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%s%s %.1f", t.stages.empty() ? "" : ", ", name,
+		std::chrono::duration<double, std::milli>(now - t.last).count());
+	t.stages += buf;
+	t.last = now;
+}
+
+static void stage_print(const stage_timer& t) {
+	printf("  import stages (%s): %s = %.1f ms\n", import_profile_name(current_import_profile), t.stages.c_str(),
+		std::chrono::duration<double, std::milli>(t.last - t.start).count());
+}
+
+// read a file and run the profile's post-processing on it a step at a time,
+// timing each. aiApplyPostProcessing does the same as passing the flags to
+// aiImportFile, but lets the steps be told apart
+static const aiScene* read_scene(const char* file_name, bool pretransform, stage_timer& t) {
+	unsigned int flags = import_profile_flags(current_import_profile, pretransform);
+	const aiScene* scene = aiImportFile(file_name, 0);
+	stage_end(t, "read");
+	for (size_t i = 0; scene && i < sizeof(import_steps) / sizeof(import_steps[0]); i++) {
+		if (flags & import_steps[i].flag) {
+			// on failure assimp has already freed the scene
+			scene = aiApplyPostProcessing(scene, import_steps[i].flag);
+			stage_end(t, import_steps[i].name);
+		}
+	}
+	return scene;
+}
+
+/*-----------------------------------MESH LOADING-------------------------------------*/
+
+// assimp's vectors are three floats, the same as ours, so whole arrays can be
+// copied across as they are
+static_assert(sizeof(aiVector3D) == sizeof(vec3), "aiVector3D no longer matches vec3");
+
+// how many triangle corners an assimp mesh has. sequential is set if every
+// face f is just vertices 3f, 3f+1 and 3f+2, which is how importers that don't
+// join vertices leave them, so the corners are the vertex arrays as they are
+static size_t count_corners(const aiMesh* mesh, bool& sequential) {
+	sequential = mesh->mNumVertices == mesh->mNumFaces * 3;
+	if (!mesh->HasPositions()) {
+		return 0;
+	}
+	size_t corners = 0;
+	for (unsigned int f_i = 0; f_i < mesh->mNumFaces; f_i++) {
+		const aiFace& face = mesh->mFaces[f_i];
+		// triangulate leaves points and lines alone, and we only draw triangles
+		if (face.mNumIndices != 3) {
+			sequential = false;
+			continue;
+		}
+		sequential = sequential && face.mIndices[0] == f_i * 3 && face.mIndices[1] == f_i * 3 + 1 &&
+			face.mIndices[2] == f_i * 3 + 2;
+		corners += 3;
+	}
+	return corners;
+}
+
+// look up each triangle corner's entry in src
+static void gather_vec3s(const aiMesh* mesh, const aiVector3D* src, vec3* out) {
+	const vec3* in = (const vec3*)src;
+	for (unsigned int f_i = 0; f_i < mesh->mNumFaces; f_i++) {
+		const aiFace& face = mesh->mFaces[f_i];
+		if (face.mNumIndices == 3) {
+			out[0] = in[face.mIndices[0]];
+			out[1] = in[face.mIndices[1]];
+			out[2] = in[face.mIndices[2]];
+			out += 3;
+		}
+	}
+}
+
+static void gather_uvs(const aiMesh* mesh, const aiVector3D* src, vec2* out) {
+	for (unsigned int f_i = 0; f_i < mesh->mNumFaces; f_i++) {
+		const aiFace& face = mesh->mFaces[f_i];
+		if (face.mNumIndices == 3) {
+			for (int c = 0; c < 3; c++) {
+				const aiVector3D& t = src[face.mIndices[c]];
+				out[c] = vec2(t.x, t.y);
+			}
+			out += 3;
+		}
+	}
+}
+
+// assimp matrices are row major, the same as affine, and nodes never project
+static affine to_affine(const aiMatrix4x4& a) {
+	affine r;
+	const float* src = &a.a1;
+	memcpy(r.m, src, sizeof(r.m));
+	return r;
+}
+
+// move a run of corners from a mesh's space into the world. the normals come
+// out unnormalised if the transform scales, the mesh gets normalised later
+static void transform_corners(const affine& world, vec3* points, vec3* normals, int count) {
+	affine identity = identity_affine();
+	if (0 == memcmp(world.m, identity.m, sizeof(world.m))) {
+		return;
+	}
+	transform_points(to_mat4(world), points, points, count);
+	// the normal matrix in the top left of a mat4, for transform_directions
+	mat3 n = normal_matrix(world);
+	mat4 m = identity_mat4();
+	memcpy(&m.m[0], &n.m[0], 3 * sizeof(float));
+	memcpy(&m.m[4], &n.m[3], 3 * sizeof(float));
+	memcpy(&m.m[8], &n.m[6], 3 * sizeof(float));
+	transform_directions(m, normals, normals, count);
+}
+
+/* every triangle corner of the meshes, one mesh after another, with zeros for
+a missing normal or uv. the arrays are sized once from the corner counts and
+each attribute is filled in its own pass, so nothing reallocates and the
+has-normals/has-uvs checks are once per mesh. meshes whose faces just run
+through the vertices in order are copied across whole, with the uvs narrowed
+from 3D by vec3s_to_vec2s. if worlds is given each mesh's corners are moved
+by its transform */
+static void extract_corners(const aiMesh* const* meshes, unsigned int mesh_count, std::vector<vec3>& points,
+	std::vector<vec3>& normals, std::vector<vec2>& uvs, const affine* worlds = NULL) {
+	std::vector<size_t> counts(mesh_count);
+	std::vector<unsigned char> sequential(mesh_count);
+	size_t total = 0;
+	for (unsigned int m_i = 0; m_i < mesh_count; m_i++) {
+		bool seq;
+		counts[m_i] = count_corners(meshes[m_i], seq);
+		sequential[m_i] = seq;
+		total += counts[m_i];
+	}
+	points.resize(total);
+	normals.resize(total);
+	uvs.resize(total);
+
+	size_t at = 0;
+	for (unsigned int m_i = 0; m_i < mesh_count; m_i++) {
+		const aiMesh* mesh = meshes[m_i];
+		size_t n = counts[m_i];
+		if (0 == n) {
+			continue;
+		}
+		// vec3 has a user-provided constructor, so the compiler wants to be told
+		// a raw copy into it is fine. it's only ever three floats
+		if (sequential[m_i]) {
+			memcpy((void*)&points[at], mesh->mVertices, n * sizeof(vec3));
+		} else {
+			gather_vec3s(mesh, mesh->mVertices, &points[at]);
+		}
+		if (!mesh->HasNormals()) {
+			std::fill_n(&normals[at], n, vec3(0.0f, 0.0f, 0.0f));
+		} else if (sequential[m_i]) {
+			memcpy((void*)&normals[at], mesh->mNormals, n * sizeof(vec3));
+		} else {
+			gather_vec3s(mesh, mesh->mNormals, &normals[at]);
+		}
+		if (!mesh->HasTextureCoords(0)) {
+			std::fill_n(&uvs[at], n, vec2(0.0f, 0.0f));
+		} else if (sequential[m_i]) {
+			vec3s_to_vec2s((const vec3*)mesh->mTextureCoords[0], &uvs[at], (int)n);
+		} else {
+			gather_uvs(mesh, mesh->mTextureCoords[0], &uvs[at]);
+		}
+		if (worlds) {
+			transform_corners(worlds[m_i], &points[at], &normals[at], (int)n);
+		}
+		at += n;
+	}
+}
+
+// the straightforward way, one push_back per attribute per corner into vectors
+// that start empty. only kept for extraction_benchmark to measure against
+static void extract_corners_push_back(const aiMesh* mesh, std::vector<vec3>& points, std::vector<vec3>& normals,
+	std::vector<vec2>& uvs) {
+	for (unsigned int f_i = 0; f_i < mesh->mNumFaces; f_i++) {
+		const aiFace* face = &(mesh->mFaces[f_i]);
+		if (face->mNumIndices != 3) {
+			continue;
+		}
+		for (unsigned int c_i = 0; c_i < 3; c_i++) {
+			unsigned int v_i = face->mIndices[c_i];
+			const aiVector3D* vp = &(mesh->mVertices[v_i]);
+			points.push_back(vec3(vp->x, vp->y, vp->z));
+			if (mesh->HasNormals()) {
+				const aiVector3D* vn = &(mesh->mNormals[v_i]);
+				normals.push_back(vec3(vn->x, vn->y, vn->z));
+			} else {
+				normals.push_back(vec3(0.0f, 0.0f, 0.0f));
+			}
+			if (mesh->HasTextureCoords(0)) {
+				const aiVector3D* vt = &(mesh->mTextureCoords[0][v_i]);
+				uvs.push_back(vec2(vt->x, vt->y));
+			} else {
+				uvs.push_back(vec2(0.0f, 0.0f));
+			}
+		}
+	}
+}
+
+// a side x side grid. joined shares each vertex between its triangles, like an
+// importer that joins vertices. otherwise every corner gets its own vertex,
+// like the collada files here
+static aiMesh* make_benchmark_mesh(int side, bool joined) {
+	aiMesh* mesh = new aiMesh();
+	int quads = (side - 1) * (side - 1);
+	mesh->mNumFaces = quads * 2;
+	mesh->mNumVertices = joined ? side * side : mesh->mNumFaces * 3;
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+	mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	unsigned int v = 0;
+	for (int q = 0; q < quads; q++) {
+		int x = q % (side - 1);
+		int y = q / (side - 1);
+		unsigned int grid[6] = {
+			(unsigned int)(y * side + x), (unsigned int)(y * side + x + 1), (unsigned int)((y + 1) * side + x + 1),
+			(unsigned int)(y * side + x), (unsigned int)((y + 1) * side + x + 1), (unsigned int)((y + 1) * side + x)
+		};
+		for (int t = 0; t < 2; t++) {
+			aiFace& face = mesh->mFaces[q * 2 + t];
+			face.mNumIndices = 3;
+			face.mIndices = new unsigned int[3];
+			for (int c = 0; c < 3; c++) {
+				face.mIndices[c] = joined ? grid[t * 3 + c] : v++;
+			}
+		}
+	}
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		float gx = (float)(i % side), gy = (float)(i / side);
+		mesh->mVertices[i].x = gx;
+		mesh->mVertices[i].y = sinf(gx * 0.1f) * cosf(gy * 0.1f);
+		mesh->mVertices[i].z = gy;
+		mesh->mNormals[i].x = 0.0f;
+		mesh->mNormals[i].y = 1.0f;
+		mesh->mNormals[i].z = 0.0f;
+		mesh->mTextureCoords[0][i].x = gx / side;
+		mesh->mTextureCoords[0][i].y = gy / side;
+		mesh->mTextureCoords[0][i].z = 0.0f;
+	}
+	return mesh;
+}
+
+void extraction_benchmark(int vertex_count) {
+	int side = (int)sqrtf((float)vertex_count);
+	for (int joined = 0; joined < 2; joined++) {
+		// an unjoined grid has 6 vertices per quad, so shrink it to about the same count
+		aiMesh* mesh = make_benchmark_mesh(joined ? side : (int)(side / sqrtf(6.0f)), 0 != joined);
+		std::vector<vec3> p0, n0, p1, n1;
+		std::vector<vec2> t0, t1;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		extract_corners_push_back(mesh, p0, n0, t0);
+		double before = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		start = std::chrono::steady_clock::now();
+		extract_corners(&mesh, 1, p1, n1, t1);
+		double after = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		bool same = p0.size() == p1.size() && 0 == memcmp(p0.data(), p1.data(), p0.size() * sizeof(vec3)) &&
+			0 == memcmp(n0.data(), n1.data(), n0.size() * sizeof(vec3)) &&
+			0 == memcmp(t0.data(), t1.data(), t0.size() * sizeof(vec2));
+		printf("  extracting %i vertices, %i corners (%s): push_back %.1f ms, sized %.1f ms, %.1fx%s\n",
+			mesh->mNumVertices, (int)p1.size(), joined ? "joined" : "one vertex per corner", before, after,
+			after > 0.0 ? before / after : 0.0, same ? "" : ", OUTPUT DIFFERS");
+		delete mesh;
+	}
+}
+
+// every mesh the node tree draws, once for each node that draws it, and where
+// that node puts it. after PreTransformVertices it's just each mesh once, as is
+static void gather_instances(const aiScene* scene, const aiNode* node, const affine& parent,
+	std::vector<const aiMesh*>& meshes, std::vector<affine>& worlds) {
+	affine world = parent * to_affine(node->mTransformation);
+	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+		meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+		worlds.push_back(world);
+	}
+	for (unsigned int c = 0; c < node->mNumChildren; c++) {
+		gather_instances(scene, node->mChildren[c], world, meshes, worlds);
+	}
+}
+
+// the full assimp import and processing, for when there's no usable cache.
+// each stage's time goes into t
+static bool import_mesh(const char* file_name, ModelData& modelData, stage_timer& t) {
+	/* Use assimp to read the model file, forcing it to be read as    */
+	/* triangles. The fast profile flattens the node tree with        */
+	/* aiProcess_PreTransformVertices, so meshes that are offset from */
+	/* the origin are in the right position. The quality profile      */
+	/* keeps the (optimised) tree and the nodes are applied below.    */
+	const aiScene* scene = read_scene(file_name, IMPORT_FAST == current_import_profile, t);
+
+	if (!scene) {
+		fprintf(stderr, "ERROR: reading mesh %s\n", file_name);
+		return false;
+	}
+
+	printf("  %i materials\n", scene->mNumMaterials);
+	printf("  %i meshes\n", scene->mNumMeshes);
+	printf("  %i textures\n", scene->mNumTextures);
+
+	// gather every triangle corner, then weld the lot into shared vertices
+	std::vector<vec3> points;
+	std::vector<vec3> normals;
+	std::vector<vec2> uvs;
+	for (unsigned int m_i = 0; m_i < scene->mNumMeshes; m_i++) {
+		printf("    %i vertices in mesh\n", scene->mMeshes[m_i]->mNumVertices);
+	}
+	std::vector<const aiMesh*> instances;
+	std::vector<affine> worlds;
+	if (scene->mRootNode) {
+		gather_instances(scene, scene->mRootNode, identity_affine(), instances, worlds);
+	} else {
+		instances.assign(scene->mMeshes, scene->mMeshes + scene->mNumMeshes);
+		worlds.assign(scene->mNumMeshes, identity_affine());
+	}
+	extract_corners(instances.data(), (unsigned int)instances.size(), points, normals, uvs, worlds.data());
+	aiReleaseImport(scene);
+	stage_end(t, "extract");
+
+	int corners = (int)points.size();
+	weld_vertices(points.data(), normals.data(), uvs.data(), corners, modelData);
+	stage_end(t, "weld");
+	optimise_mesh(modelData);
+	stage_end(t, "optimise");
+	// exporters don't always write unit normals, and the shader relies on them
+	normalise_vec3s(modelData.mNormals.data(), modelData.mNormals.data(), (int)modelData.mNormals.size());
+	generate_tangents(modelData);
+	stage_end(t, "tangents");
+	// meshlets reorder the triangles, so number the vertices again in the final
+	// order, which also brings the tangent twins in from the end. meshlets are
+	// index ranges with bounds in model space, so renumbering leaves them right,
+	// and the LODs are built over the renumbered vertices
+	build_meshlets(modelData);
+	optimise_vertex_fetch(modelData);
+	modelData.mBounds = aabb_from_points(modelData.mVertices.data(), (int)modelData.mVertices.size());
+	stage_end(t, "meshlets");
+	build_lods(modelData);
+	stage_end(t, "lods");
+
+	// what welding saved: one position, normal and uv per corner before, against
+	// one per unique vertex plus the index buffer after
+	size_t vertex_bytes = sizeof(vec3) * 2 + sizeof(vec2);
+	size_t index_bytes = needs_32bit_indices(modelData) ? 4 : 2;
+	size_t before = corners * vertex_bytes;
+	size_t after = modelData.mPointCount * vertex_bytes + modelData.mIndices.size() * index_bytes;
+	printf("  welded %i corners into %i vertices (%.1f%% fewer)\n", corners, (int)modelData.mPointCount,
+		corners > 0 ? 100.0 * (corners - (int)modelData.mPointCount) / corners : 0.0);
+	printf("  vertex data %.1f KB -> %.1f KB with %i-bit indices\n", before / 1024.0, after / 1024.0,
+		(int)index_bytes * 8);
+
+	return true;
+}
+
+ModelData load_mesh(const char* file_name) {
+	ModelData modelData;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool cached = load_mesh_cache(file_name, modelData);
+	if (!cached) {
+		stage_timer t;
+		stage_begin(t);
+		if (!import_mesh(file_name, modelData, t)) {
+			return modelData;
+		}
+		if (!save_mesh_cache(file_name, modelData)) {
+			fprintf(stderr, "WARNING. could not write mesh cache for %s\n", file_name);
+		}
+		stage_end(t, "cache");
+		stage_print(t);
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("  %s: %i vertices, %i triangles in %.2f ms (%s)\n", file_name, (int)modelData.mPointCount,
+		(int)modelData.mIndices.size() / 3, ms, cached ? "from cache" : "imported");
+	return modelData;
+}
+
+bool map_mesh(const char* file_name, mesh_mapping& mm) {
+	unmap_mesh(mm);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::string path = cache_name(file_name);
+	mesh_cache_header h;
+	bool cached = false;
+	if (map_file(path.c_str(), mm.file)) {
+		cached = check_cache_image(file_name, (const char*)mm.file.data, mm.file.size, false, h);
+		if (cached) {
+			set_mapping((const char*)mm.file.data, h, mm);
+		} else {
+			printf("  mesh cache %s is stale, damaged or from the other import profile, reimporting\n", path.c_str());
+			unmap_file(mm.file);
+		}
+	}
+	if (!cached) {
+		// import, and use the freshly built image from memory. the ModelData goes
+		// as soon as the image is built, so only one copy is ever held
+		stage_timer t;
+		stage_begin(t);
+		{
+			ModelData modelData;
+			if (!import_mesh(file_name, modelData, t) || !build_cache_image(file_name, modelData, mm.owned)) {
+				return false;
+			}
+		}
+		stage_end(t, "cache image");
+		if (!write_file_atomic(path.c_str(), mm.owned.data(), mm.owned.size())) {
+			fprintf(stderr, "WARNING. could not write mesh cache for %s\n", file_name);
+		}
+		stage_end(t, "write");
+		stage_print(t);
+		memcpy(&h, mm.owned.data(), sizeof(h));
+		set_mapping(mm.owned.data(), h, mm);
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("  %s: %i vertices, %i triangles in %.2f ms (%s)\n", file_name, mm.vertex_count,
+		(int)mm.lods[0].index_count / 3, ms, cached ? "mapped" : "imported");
+	return true;
+}
+
+void map_model(const ModelData& mesh, mesh_mapping& mm) {
+	unmap_mesh(mm);
+	fill_cache_image(mesh, 0, 0, mm.owned);
+	mesh_cache_header h;
+	memcpy(&h, mm.owned.data(), sizeof(h));
+	set_mapping(mm.owned.data(), h, mm);
+}
+
+bool view_mesh_image(const void* data, size_t size, mesh_mapping& mm) {
+	unmap_mesh(mm);
+	mesh_cache_header h;
+	if (!check_cache_layout((const char*)data, size, h)) {
+		return false;
+	}
+	set_mapping((const char*)data, h, mm);
+	return true;
+}
+
+void unmap_mesh(mesh_mapping& mm) {
+	unmap_file(mm.file);
+	std::vector<char>().swap(mm.owned);
+	mm.vertex_data = NULL;
+	mm.index_data = NULL;
+	mm.vertex_bytes = 0;
+	mm.index_bytes = 0;
+	mm.vertex_count = 0;
+	mm.index_count = 0;
+	mm.meshlets = NULL;
+	mm.meshlet_count = 0;
+}
+
+/*---------------------------------------SCENES---------------------------------------*/
+
+static void load_scene_nodes(const aiNode* node, int parent, mesh_scene& out) {
+	scene_node n;
+	n.name = node->mName.C_Str();
+	n.parent = parent;
+	n.local = to_affine(node->mTransformation);
+	n.world = (parent < 0) ? n.local : out.nodes[parent].world * n.local;
+	n.meshes.assign(node->mMeshes, node->mMeshes + node->mNumMeshes);
+	bool any = false;
+	for (size_t i = 0; i < n.meshes.size(); i++) {
+		aabb b = transform_aabb(to_mat4(n.world), out.meshes[n.meshes[i]].bounds);
+		if (!any) {
+			n.bounds = b;
+			any = true;
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			n.bounds.mn.v[k] = b.mn.v[k] < n.bounds.mn.v[k] ? b.mn.v[k] : n.bounds.mn.v[k];
+			n.bounds.mx.v[k] = b.mx.v[k] > n.bounds.mx.v[k] ? b.mx.v[k] : n.bounds.mx.v[k];
+		}
+	}
+	if (!any) {
+		// nothing to draw here, and a zero box in the right place never gets culled wrongly
+		vec3 at(n.world.m[3], n.world.m[7], n.world.m[11]);
+		n.bounds = aabb(at, at);
+	}
+	int index = (int)out.nodes.size();
+	out.nodes.push_back(n);
+	for (unsigned int c = 0; c < node->mNumChildren; c++) {
+		load_scene_nodes(node->mChildren[c], index, out);
+	}
+}
+
+static bool draw_before(const scene_draw& a, const scene_draw& b) {
+	if (a.material != b.material) {
+		return a.material < b.material;
+	}
+	return a.mesh < b.mesh;
+}
+
+bool load_scene(const char* file_name, mesh_scene& out, bool pretransform) {
+	stage_timer t;
+	stage_begin(t);
+	const aiScene* scene = read_scene(file_name, pretransform, t);
+	if (!scene) {
+		fprintf(stderr, "ERROR: reading scene %s\n", file_name);
+		return false;
+	}
+
+	out = mesh_scene();
+	for (unsigned int m_i = 0; m_i < scene->mNumMaterials; m_i++) {
+		const aiMaterial* mat = scene->mMaterials[m_i];
+		scene_material sm;
+		aiString str;
+		if (AI_SUCCESS == aiGetMaterialString(mat, AI_MATKEY_NAME, &str)) {
+			sm.name = str.C_Str();
+		}
+		if (mat->GetTextureCount(aiTextureType_DIFFUSE) > 0 &&
+			AI_SUCCESS == mat->GetTexture(aiTextureType_DIFFUSE, 0, &str)) {
+			sm.diffuse_texture = str.C_Str();
+		}
+		aiColor4D colour;
+		sm.diffuse = vec3(1.0f, 1.0f, 1.0f);
+		if (AI_SUCCESS == aiGetMaterialColor(mat, AI_MATKEY_COLOR_DIFFUSE, &colour)) {
+			sm.diffuse = vec3(colour.r, colour.g, colour.b);
+		}
+		out.materials.push_back(sm);
+	}
+
+	// each mesh is welded and optimised on its own, so its triangles stay one
+	// run, then added onto the end of the shared arrays
+	ModelData& geo = out.geometry;
+	for (unsigned int m_i = 0; m_i < scene->mNumMeshes; m_i++) {
+		const aiMesh* mesh = scene->mMeshes[m_i];
+		std::vector<vec3> points;
+		std::vector<vec3> normals;
+		std::vector<vec2> uvs;
+		extract_corners(&scene->mMeshes[m_i], 1, points, normals, uvs);
+		ModelData part;
+		weld_vertices(points.data(), normals.data(), uvs.data(), (int)points.size(), part);
+		optimise_mesh(part);
+		normalise_vec3s(part.mNormals.data(), part.mNormals.data(), (int)part.mNormals.size());
+		generate_tangents(part);
+
+		scene_mesh sm;
+		sm.first_index = (unsigned int)geo.mIndices.size();
+		sm.index_count = (unsigned int)part.mIndices.size();
+		sm.material = (int)mesh->mMaterialIndex < (int)out.materials.size() ? (int)mesh->mMaterialIndex : -1;
+		sm.bounds = aabb_from_points(part.mVertices.data(), (int)part.mVertices.size());
+		out.meshes.push_back(sm);
+
+		unsigned int base = (unsigned int)geo.mPointCount;
+		geo.mVertices.insert(geo.mVertices.end(), part.mVertices.begin(), part.mVertices.end());
+		geo.mNormals.insert(geo.mNormals.end(), part.mNormals.begin(), part.mNormals.end());
+		geo.mTextureCoords.insert(geo.mTextureCoords.end(), part.mTextureCoords.begin(), part.mTextureCoords.end());
+		geo.mTangents.insert(geo.mTangents.end(), part.mTangents.begin(), part.mTangents.end());
+		geo.mIndices.reserve(geo.mIndices.size() + part.mIndices.size());
+		for (size_t i = 0; i < part.mIndices.size(); i++) {
+			geo.mIndices.push_back(base + part.mIndices[i]);
+		}
+		geo.mPointCount += part.mPointCount;
+	}
+	// only good for sizing things up, the meshes aren't in one space
+	geo.mBounds = aabb_from_points(geo.mVertices.data(), (int)geo.mVertices.size());
+	stage_end(t, "meshes");
+
+	if (scene->mRootNode) {
+		load_scene_nodes(scene->mRootNode, -1, out);
+	}
+	aiReleaseImport(scene);
+
+	for (size_t n = 0; n < out.nodes.size(); n++) {
+		for (size_t i = 0; i < out.nodes[n].meshes.size(); i++) {
+			scene_draw d;
+			d.node = (int)n;
+			d.mesh = out.nodes[n].meshes[i];
+			d.material = out.meshes[d.mesh].material;
+			out.draws.push_back(d);
+		}
+	}
+	std::stable_sort(out.draws.begin(), out.draws.end(), draw_before);
+	stage_end(t, "nodes");
+	stage_print(t);
+
+	double ms = std::chrono::duration<double, std::milli>(t.last - t.start).count();
+	printf("  %s: %i meshes, %i materials, %i nodes, %i draws, %i vertices, %i triangles in %.2f ms\n",
+		file_name, (int)out.meshes.size(), (int)out.materials.size(), (int)out.nodes.size(),
+		(int)out.draws.size(), (int)geo.mPointCount, (int)geo.mIndices.size() / 3, ms);
+	return true;
+}
+
+int cull_scene(const mesh_scene& s, const mat4& view_proj, std::vector<int>& visible) {
+	frustum f = extract_frustum(view_proj);
+	std::vector<unsigned char> node_visible(s.nodes.size());
+	for (size_t n = 0; n < s.nodes.size(); n++) {
+		node_visible[n] = classify(f, s.nodes[n].bounds) != CULL_OUTSIDE;
+	}
+	visible.clear();
+	int batches = 0;
+	int material = -2;
+	for (size_t d = 0; d < s.draws.size(); d++) {
+		if (!node_visible[s.draws[d].node]) {
+			continue;
+		}
+		visible.push_back((int)d);
+		if (s.draws[d].material != material) {
+			material = s.draws[d].material;
+			batches++;
+		}
+	}
+	return batches;
+}
+
+/*------------------------------------SIMPLE SHAPES-----------------------------------*/
+
+void make_box(ModelData& out) {
+	// one quad per face so each face gets its own normal and the full 0-1 uvs
+	static const float faces[6][3] = {
+		{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+	};
+	out = ModelData();
+	for (int f = 0; f < 6; f++) {
+		vec3 n(faces[f][0], faces[f][1], faces[f][2]);
+		// two axes across the face, with u x v pointing out along n so the
+		// triangles wind counter-clockwise seen from outside
+		vec3 u = (0.0f != n.v[0]) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+		vec3 v = cross(n, u);
+		unsigned int base = (unsigned int)out.mVertices.size();
+		for (int c = 0; c < 4; c++) {
+			float s = (c & 1) ? 1.0f : -1.0f;
+			float t = (c & 2) ? 1.0f : -1.0f;
+			out.mVertices.push_back(n + u * s + v * t);
+			out.mNormals.push_back(n);
+			out.mTextureCoords.push_back(vec2(0.5f + 0.5f * s, 0.5f + 0.5f * t));
+			out.mTangents.push_back(vec4(u, 1.0f));
+		}
+		unsigned int quad[6] = { 0, 1, 3, 0, 3, 2 };
+		for (int i = 0; i < 6; i++) {
+			out.mIndices.push_back(base + quad[i]);
+		}
+	}
+	out.mPointCount = out.mVertices.size();
+	out.mBounds = aabb(vec3(-1.0f, -1.0f, -1.0f), vec3(1.0f, 1.0f, 1.0f));
+}
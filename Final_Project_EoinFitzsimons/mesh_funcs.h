@@ -0,0 +1,303 @@
+#ifndef _MESH_FUNCS_H_
+#define _MESH_FUNCS_H_
+
+#include <string>
+#include <vector>
+#include "maths_funcs.h"
+#include "file_funcs.h"
+
+// full detail plus up to 3 simplified levels
+#define MAX_MESH_LODS 4
+
+/* a simplified version of a mesh: its own triangles over the same vertices.
+error is the furthest any full detail vertex is from these triangles, in model
+units */
+struct mesh_lod {
+	std::vector<unsigned int> indices;
+	float error;
+};
+
+// meshlet size limits. small enough that a meshlet's bounds and cone stay
+// tight, and the same limits mesh shaders like
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+/* a small patch of a mesh's full detail triangles, with what it takes to cull
+it on its own. the patch is off screen if its bounding sphere is outside the
+view volume, and faces away if an eye at e sees
+	dot(bounds.centre - e, cone_axis) >= cone_cutoff * length(bounds.centre - e) + bounds.radius
+cone_axis is the triangles' average facing and cone_cutoff the sine of the
+widest angle any of them make with it, or 1 (never faces away) when they
+spread too far for the test to work. all in model space */
+struct meshlet {
+	unsigned int first_index; // into the index buffer, inside level 0
+	unsigned int index_count;
+	sphere bounds;
+	vec3 cone_axis;
+	float cone_cutoff;
+};
+
+/* an indexed triangle mesh. every vertex has a position, normal, texture
+coordinate (zeros where the file had none) and tangent, and mIndices holds 3
+entries per triangle into those arrays */
+typedef struct
+{
+	size_t mPointCount = 0; // unique vertices
+	std::vector<vec3> mVertices;
+	std::vector<vec3> mNormals;
+	std::vector<vec2> mTextureCoords;
+	// xyz is the unit tangent, pointing along +u. w is +1 or -1, and the
+	// bitangent (along +v) is w * cross(normal, tangent)
+	std::vector<vec4> mTangents;
+	std::vector<unsigned int> mIndices;
+	std::vector<mesh_lod> mLods; // coarser levels after mIndices, each about half the last
+	std::vector<meshlet> mMeshlets; // mIndices split into patches, in order
+	aabb mBounds; // model space, for frustum culling
+} ModelData;
+
+/* how much of an import assimp does before our own welding and optimising.
+IMPORT_FAST     triangulate and flatten the node tree into the vertices.
+                everything else is left to our own passes
+IMPORT_QUALITY  also has assimp join identical vertices, order them for its
+                vertex cache, merge small meshes, collapse the node tree and
+                make smooth normals for meshes that have none. slower, but
+                copes better with files in lots of little pieces or without
+                normals
+set the profile before loading anything. it's stored in the mesh cache, so
+switching reimports. every import prints how long each stage took */
+#define IMPORT_FAST 0
+#define IMPORT_QUALITY 1
+#define IMPORT_PROFILE_COUNT 2
+#define DEFAULT_IMPORT_PROFILE IMPORT_FAST
+void set_import_profile(int profile);
+int get_import_profile();
+const char* import_profile_name(int profile);
+// "fast" or "quality" to its profile, false if it's neither
+bool parse_import_profile(const char* name, int& profile);
+
+// load every mesh in a file into one indexed mesh, welding identical corners.
+// the result is cached next to the file (see below) and later loads come
+// straight from that while the file is unchanged
+ModelData load_mesh(const char* file_name);
+// benchmark: pull the corners of a synthetic mesh of about vertex_count
+// vertices out of assimp's arrays the way the importers do, against one
+// push_back per corner, and print both times
+void extraction_benchmark(int vertex_count);
+
+// binary cache of a processed mesh, kept as <source>.cache. it is only used
+// while the source's modification time and size match the ones it was written
+// with, it was imported with the current profile, and its checksum is good.
+// bump the version whenever the import processing or the layout changes, so
+// old caches get rebuilt
+#define MESH_CACHE_VERSION 9
+bool load_mesh_cache(const char* source_name, ModelData& out);
+bool save_mesh_cache(const char* source_name, const ModelData& mesh);
+
+/* vertex formats for the cache, and so the GL buffers.
+VERTEX_FLOAT      48 bytes: float position, normal, uv and tangent (with its
+                  sign in w)
+VERTEX_QUANTISED  20 bytes: position as 3 unorm16s across the mesh's bounds
+                  plus the tangent's sign as a 4th (0 = -1, 65535 = +1),
+                  normal and tangent as 2 snorm16s each octahedral encoded,
+                  uv as 2 half floats. the position error is at most
+                  1/131070 of the bounds on each axis and the normal and
+                  tangent errors well under 0.01 degrees. uvs lose more
+                  the further they get from 0 (1/2048 at 1, 1/64 at 32),
+                  which is fine for uvs that tile a few times but not for
+                  huge ones
+the vertex shader turns them back into floats */
+#define VERTEX_FLOAT 0
+#define VERTEX_QUANTISED 1
+// the format new caches are written in
+#define MESH_VERTEX_FORMAT VERTEX_QUANTISED
+
+// where a level of detail's triangles are in a mesh_mapping's index buffer.
+// level 0 is the full detail mesh, with an error of 0
+struct mesh_lod_range {
+	unsigned int first_index;
+	unsigned int index_count;
+	float error;
+};
+
+/* a mesh ready for glBufferData without any copying. the cache file is laid
+out exactly like the GL buffers: one vertex buffer holding all the positions,
+then all the normals, then all the uvs, and an index buffer already in its
+final 16 or 32 bit type. the pointers go straight into the file mapping, or
+into owned if the mesh had to be imported */
+struct mesh_mapping {
+	mapped_file file;
+	std::vector<char> owned;
+	const void* vertex_data = NULL;
+	size_t vertex_bytes = 0;
+	size_t normal_offset = 0; // byte offsets into vertex_data
+	size_t uv_offset = 0;
+	size_t tangent_offset = 0;
+	const void* index_data = NULL;
+	size_t index_bytes = 0;
+	int vertex_count = 0;
+	int index_count = 0; // every level of detail
+	int index_size = 0; // 2 or 4 bytes
+	int lod_count = 0;
+	mesh_lod_range lods[MAX_MESH_LODS]; // the index buffer holds every level, finest first
+	const meshlet* meshlets = NULL; // level 0 split up, also straight out of the file
+	int meshlet_count = 0;
+	int vertex_format = VERTEX_FLOAT;
+	// the shader's position = position_offset + stored position * position_scale
+	vec3 position_offset;
+	vec3 position_scale;
+	aabb bounds;
+};
+// map a mesh's cache, importing the mesh and writing the cache first if there
+// isn't a current one. the checksum isn't checked here, so each byte is only
+// read once, by the upload
+bool map_mesh(const char* file_name, mesh_mapping& mm);
+void unmap_mesh(mesh_mapping& mm);
+// the same, for a mesh that's already in memory (eg. one built in code). the
+// image is built in mm.owned
+void map_model(const ModelData& mesh, mesh_mapping& mm);
+// point a mapping at a mesh image someone else holds (eg. one of the chunks in
+// a chunked mesh), without copying it. the image must outlive the mapping.
+// false if it isn't a whole image of the current version
+bool view_mesh_image(const void* data, size_t size, mesh_mapping& mm);
+
+// a -1 to 1 cube with per-face normals and 0-1 uvs on every face
+void make_box(ModelData& out);
+
+/* a file kept the way it was built, rather than flattened into one mesh by
+load_mesh, so it can be drawn a material at a time and culled a node at a
+time. every mesh is welded and optimised on its own and then added onto one
+shared ModelData, so the whole scene still fits in one vertex buffer and one
+index buffer, and each mesh is a run of its indices */
+struct scene_mesh {
+	unsigned int first_index; // into geometry.mIndices
+	unsigned int index_count;
+	int material; // into materials, -1 if the file's index was bad
+	aabb bounds; // in the mesh's own space
+};
+
+struct scene_material {
+	std::string name;
+	std::string diffuse_texture; // as written in the file, empty if none
+	vec3 diffuse; // colour, white if the file doesn't say
+};
+
+// places its meshes in the world. parents always come before their children
+struct scene_node {
+	std::string name;
+	int parent; // -1 for the root
+	affine local; // relative to the parent
+	affine world;
+	std::vector<int> meshes; // into mesh_scene::meshes. meshes can be shared by nodes
+	aabb bounds; // world space, around this node's own meshes only
+};
+
+// one mesh drawn by one node
+struct scene_draw {
+	int node;
+	int mesh;
+	int material;
+};
+
+struct mesh_scene {
+	ModelData geometry; // mBounds is only a rough size, the meshes aren't in one space
+	std::vector<scene_mesh> meshes;
+	std::vector<scene_material> materials;
+	std::vector<scene_node> nodes;
+	std::vector<scene_draw> draws; // every node's meshes, sorted by material so each is one batch
+};
+
+// import a file keeping its meshes, materials and node tree, with the current
+// import profile. with pretransform assimp bakes the node transforms into the
+// vertices first, which also merges meshes that share a material, leaving one
+// node. not cached
+bool load_scene(const char* file_name, mesh_scene& out, bool pretransform = false);
+// fill visible with the indices of the draws whose node is at least partly
+// inside the view volume, still in material order. returns how many material
+// batches that makes
+int cull_scene(const mesh_scene& s, const mat4& view_proj, std::vector<int>& visible);
+
+// build an indexed mesh from a triangle list with one entry per corner.
+// corners with bit-identical position, normal and uv become one vertex.
+// normals and uvs may be NULL
+void weld_vertices(const vec3* points, const vec3* normals, const vec2* uvs, int corner_count, ModelData& out);
+
+/* fill in mTangents from the positions, normals and uvs, the way MikkTSpace
+(the baker convention most normal maps are made for) does it: each triangle's
++u direction is projected onto the plane of each corner's normal and weighted
+by the corner's angle, and triangles whose uvs are mirrored count separately.
+a vertex shared by triangles of both handednesses is split in two, appended
+to the end, so the vertex count and indices can change. vertices with no
+usable uvs get any tangent at right angles to the normal. split over
+num_threads threads (0 = one per core), small meshes stay on this thread */
+void generate_tangents(ModelData& mesh, int num_threads = 0);
+
+// post-transform vertex cache size the optimiser and the stats assume. on the
+// small side for current GPUs, so the ordering holds up everywhere
+#define VERTEX_CACHE_SIZE 16
+
+// all three passes below in order, printing the cache stats before and after
+void optimise_mesh(ModelData& mesh);
+// reorder the triangles for the vertex cache with Tipsy (Sander, Nehab and
+// Barczak 2007). if clusters is given it gets the first triangle of each run
+// that starts with a cold cache, for optimise_overdraw
+void optimise_vertex_cache(ModelData& mesh, std::vector<int>* clusters = NULL);
+// sort those clusters so the ones facing out from the middle of the mesh are
+// drawn first and hide more of the rest. the order inside a cluster is kept,
+// so the cache behaviour barely changes
+void optimise_overdraw(ModelData& mesh, const std::vector<int>& clusters);
+// renumber the vertices in the order the indices first use them, so vertex
+// fetches walk forward through memory. unused vertices are dropped
+void optimise_vertex_fetch(ModelData& mesh);
+// simulate a FIFO cache of cache_size vertices over the index buffer. acmr is
+// misses per triangle (0.5 is about the best a regular mesh can do, 3 is the
+// worst), atvr is misses per vertex (1 is ideal)
+void cache_stats(const ModelData& mesh, int cache_size, float& acmr, float& atvr);
+
+// simplify a triangle list over mesh's vertices to about target_index_count
+// indices by quadric error edge collapse (Garland and Heckbert 1997). every
+// collapse moves a vertex onto a neighbour, so the result uses the same
+// vertices and can share their buffer. borders and uv/normal seams only move
+// along themselves, and collapses that would fold triangles over are skipped,
+// so it stops short of the target if nothing safe is left. error is the
+// square root of the worst collapse's quadric error: the area weighted mean
+// squared distance to the planes around the collapsed vertex. that's what
+// orders the collapses, but it understates how far the surface moves, often
+// several times over
+void simplify_indices(const ModelData& mesh, const std::vector<unsigned int>& indices,
+	size_t target_index_count, std::vector<unsigned int>& out, float& error);
+// fill in mesh.mLods, each level simplified from the one before to half its
+// triangles and reordered for the vertex cache. stops early once a level
+// would barely shrink. each level's error is measured against the full detail
+// vertices, not taken from the quadrics
+void build_lods(ModelData& mesh);
+
+// split mIndices into meshlets of at most MESHLET_MAX_VERTICES vertices and
+// MESHLET_MAX_TRIANGLES triangles, and reorder it so each meshlet's triangles
+// are together. each meshlet is grown from a seed by adding whichever touching
+// triangle brings in the fewest new vertices, then the one nearest the middle
+// and facing the same way, which keeps the bounds and cones tight. seeds are
+// taken in the existing triangle order, the meshlets are then sorted by
+// occlusion potential like optimise_overdraw's clusters, and each is put back
+// in vertex cache order. run optimise_vertex_fetch afterwards
+void build_meshlets(ModelData& mesh);
+// cull meshlets against a view volume and eye position, both in model space.
+// visible[i] is set to 1 if meshlet i may be seen and 0 if not, and the return
+// value is how many triangles are left. with test_cones false only the view
+// volume is checked, for when the model matrix scales unevenly and the cones
+// no longer hold
+int cull_meshlets(const meshlet* meshlets, int count, const frustum& f, const vec3& eye, bool test_cones,
+	unsigned char* visible);
+// as cull_meshlets but split into chunks over num_threads threads (0 = one per
+// core). small meshes are done on the calling thread
+int cull_meshlets_mt(const meshlet* meshlets, int count, const frustum& f, const vec3& eye, bool test_cones,
+	unsigned char* visible, int num_threads = 0);
+// benchmark: cull the meshlets from a ring of eyes around the bounds, at a few
+// distances, and print how much of the mesh the view volume and the cones each
+// cull from every one
+void meshlet_cull_report(const meshlet* meshlets, int count, const aabb& bounds);
+
+// true if the mesh has too many vertices for 16-bit indices
+bool needs_32bit_indices(const ModelData& mesh);
+// copy the indices out as 16-bit, for meshes where needs_32bit_indices() is false
+void get_16bit_indices(const ModelData& mesh, std::vector<unsigned short>& out);
+#endif
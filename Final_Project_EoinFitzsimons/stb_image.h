@@ -853,8 +853,16 @@ static stbi_uc *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp,
 static int stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+// this is not threadsafe, unless the compiler has thread locals: images are
+// decoded on the asset loader's worker threads, so keep one per thread
+#ifndef STBI_THREAD_LOCAL
+#if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#define STBI_THREAD_LOCAL thread_local
+#else
+#define STBI_THREAD_LOCAL
+#endif
+#endif
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void) { return stbi__g_failure_reason; }
 
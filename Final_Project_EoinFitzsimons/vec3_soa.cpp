@@ -0,0 +1,311 @@
+#include "vec3_soa.h"
+#include <stdlib.h>
+#include <string.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#ifdef MATHS_SSE
+#include <immintrin.h>
+#endif
+
+/*----------------------------------REGISTER WRAPPERS---------------------------------*/
+
+// every bulk function is written once against these. they map onto AVX, SSE or
+// plain floats depending on the backend picked in maths_funcs.h
+#if defined(MATHS_AVX)
+#define SOA_WIDTH 8
+typedef __m256 soa_reg;
+static inline soa_reg reg_load(const float* p) { return _mm256_load_ps(p); }
+static inline void reg_store(float* p, soa_reg a) { _mm256_store_ps(p, a); }
+static inline soa_reg reg_set1(float f) { return _mm256_set1_ps(f); }
+static inline soa_reg reg_add(soa_reg a, soa_reg b) { return _mm256_add_ps(a, b); }
+static inline soa_reg reg_sub(soa_reg a, soa_reg b) { return _mm256_sub_ps(a, b); }
+static inline soa_reg reg_mul(soa_reg a, soa_reg b) { return _mm256_mul_ps(a, b); }
+static inline soa_reg reg_min(soa_reg a, soa_reg b) { return _mm256_min_ps(a, b); }
+static inline soa_reg reg_max(soa_reg a, soa_reg b) { return _mm256_max_ps(a, b); }
+static inline soa_reg reg_sqrt(soa_reg a) { return _mm256_sqrt_ps(a); }
+// n / d, or 0 where d is 0
+static inline soa_reg reg_safe_div(soa_reg n, soa_reg d) {
+	soa_reg nonzero = _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+	return _mm256_and_ps(nonzero, _mm256_div_ps(n, d));
+}
+#elif defined(MATHS_SSE)
+#define SOA_WIDTH 4
+typedef __m128 soa_reg;
+static inline soa_reg reg_load(const float* p) { return _mm_load_ps(p); }
+static inline void reg_store(float* p, soa_reg a) { _mm_store_ps(p, a); }
+static inline soa_reg reg_set1(float f) { return _mm_set1_ps(f); }
+static inline soa_reg reg_add(soa_reg a, soa_reg b) { return _mm_add_ps(a, b); }
+static inline soa_reg reg_sub(soa_reg a, soa_reg b) { return _mm_sub_ps(a, b); }
+static inline soa_reg reg_mul(soa_reg a, soa_reg b) { return _mm_mul_ps(a, b); }
+static inline soa_reg reg_min(soa_reg a, soa_reg b) { return _mm_min_ps(a, b); }
+static inline soa_reg reg_max(soa_reg a, soa_reg b) { return _mm_max_ps(a, b); }
+static inline soa_reg reg_sqrt(soa_reg a) { return _mm_sqrt_ps(a); }
+static inline soa_reg reg_safe_div(soa_reg n, soa_reg d) {
+	soa_reg nonzero = _mm_cmpneq_ps(d, _mm_setzero_ps());
+	return _mm_and_ps(nonzero, _mm_div_ps(n, d));
+}
+#else
+#define SOA_WIDTH 1
+typedef float soa_reg;
+static inline soa_reg reg_load(const float* p) { return *p; }
+static inline void reg_store(float* p, soa_reg a) { *p = a; }
+static inline soa_reg reg_set1(float f) { return f; }
+static inline soa_reg reg_add(soa_reg a, soa_reg b) { return a + b; }
+static inline soa_reg reg_sub(soa_reg a, soa_reg b) { return a - b; }
+static inline soa_reg reg_mul(soa_reg a, soa_reg b) { return a * b; }
+static inline soa_reg reg_min(soa_reg a, soa_reg b) { return a < b ? a : b; }
+static inline soa_reg reg_max(soa_reg a, soa_reg b) { return a > b ? a : b; }
+static inline soa_reg reg_sqrt(soa_reg a) { return sqrtf(a); }
+static inline soa_reg reg_safe_div(soa_reg n, soa_reg d) { return 0.0f == d ? 0.0f : n / d; }
+#endif
+
+/*-----------------------------------ALLOCATION---------------------------------------*/
+
+static float* alloc_stream(int capacity) {
+	if (0 == capacity) {
+		return NULL;
+	}
+	size_t bytes = (size_t)capacity * sizeof(float);
+#ifdef _WIN32
+	float* p = (float*)_aligned_malloc(bytes, SOA_ALIGN);
+#else
+	void* mem = NULL;
+	float* p = (0 == posix_memalign(&mem, SOA_ALIGN, bytes)) ? (float*)mem : NULL;
+#endif
+	if (p) {
+		memset(p, 0, bytes);
+	}
+	return p;
+}
+
+static void free_stream(float* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static int padded(int count) {
+	return (count + SOA_PAD - 1) / SOA_PAD * SOA_PAD;
+}
+
+/*-----------------------------------CONSTRUCTORS-------------------------------------*/
+
+vec3_soa::vec3_soa() : count(0), capacity(0), x(NULL), y(NULL), z(NULL) {}
+
+vec3_soa::vec3_soa(int count) : count(0), capacity(0), x(NULL), y(NULL), z(NULL) {
+	resize(count);
+}
+
+vec3_soa::vec3_soa(const vec3* src, int count) : count(0), capacity(0), x(NULL), y(NULL), z(NULL) {
+	resize(count);
+	for (int i = 0; i < count; i++) {
+		x[i] = src[i].v[0];
+		y[i] = src[i].v[1];
+		z[i] = src[i].v[2];
+	}
+}
+
+vec3_soa::vec3_soa(const vec3_soa& rhs) : count(0), capacity(0), x(NULL), y(NULL), z(NULL) {
+	*this = rhs;
+}
+
+vec3_soa& vec3_soa::operator= (const vec3_soa& rhs) {
+	if (this == &rhs) {
+		return *this;
+	}
+	resize(rhs.count);
+	if (count > 0) {
+		memcpy(x, rhs.x, capacity * sizeof(float));
+		memcpy(y, rhs.y, capacity * sizeof(float));
+		memcpy(z, rhs.z, capacity * sizeof(float));
+	}
+	return *this;
+}
+
+vec3_soa::~vec3_soa() {
+	free_stream(x);
+	free_stream(y);
+	free_stream(z);
+}
+
+void vec3_soa::resize(int new_count) {
+	int new_capacity = padded(new_count);
+	if (new_capacity != capacity) {
+		float* nx = alloc_stream(new_capacity);
+		float* ny = alloc_stream(new_capacity);
+		float* nz = alloc_stream(new_capacity);
+		int keep = count < new_count ? count : new_count;
+		if (keep > 0) {
+			memcpy(nx, x, keep * sizeof(float));
+			memcpy(ny, y, keep * sizeof(float));
+			memcpy(nz, z, keep * sizeof(float));
+		}
+		free_stream(x);
+		free_stream(y);
+		free_stream(z);
+		x = nx;
+		y = ny;
+		z = nz;
+		capacity = new_capacity;
+	} else if (new_count < count) {
+		// shrinking inside the same block: re-zero the padding we just exposed
+		memset(x + new_count, 0, (count - new_count) * sizeof(float));
+		memset(y + new_count, 0, (count - new_count) * sizeof(float));
+		memset(z + new_count, 0, (count - new_count) * sizeof(float));
+	}
+	count = new_count;
+}
+
+vec3 vec3_soa::get(int i) const {
+	return vec3(x[i], y[i], z[i]);
+}
+
+void vec3_soa::set(int i, const vec3& vv) {
+	x[i] = vv.v[0];
+	y[i] = vv.v[1];
+	z[i] = vv.v[2];
+}
+
+void vec3_soa::to_vec3(vec3* dst) const {
+	for (int i = 0; i < count; i++) {
+		dst[i].v[0] = x[i];
+		dst[i].v[1] = y[i];
+		dst[i].v[2] = z[i];
+	}
+}
+
+/*---------------------------------BULK FUNCTIONS-------------------------------------*/
+
+// these run over the whole padded capacity. the padding is zero going in and
+// every op below maps zero to zero, so it stays zero coming out
+
+// with the sizes checked first, resizing out can only reallocate it when it
+// isn't one of the inputs, so nothing gets freed before it's read
+bool add(const vec3_soa& a, const vec3_soa& b, vec3_soa& out) {
+	if (a.count != b.count) {
+		return false;
+	}
+	out.resize(a.count);
+	for (int i = 0; i < a.capacity; i += SOA_WIDTH) {
+		reg_store(out.x + i, reg_add(reg_load(a.x + i), reg_load(b.x + i)));
+		reg_store(out.y + i, reg_add(reg_load(a.y + i), reg_load(b.y + i)));
+		reg_store(out.z + i, reg_add(reg_load(a.z + i), reg_load(b.z + i)));
+	}
+	return true;
+}
+
+bool sub(const vec3_soa& a, const vec3_soa& b, vec3_soa& out) {
+	if (a.count != b.count) {
+		return false;
+	}
+	out.resize(a.count);
+	for (int i = 0; i < a.capacity; i += SOA_WIDTH) {
+		reg_store(out.x + i, reg_sub(reg_load(a.x + i), reg_load(b.x + i)));
+		reg_store(out.y + i, reg_sub(reg_load(a.y + i), reg_load(b.y + i)));
+		reg_store(out.z + i, reg_sub(reg_load(a.z + i), reg_load(b.z + i)));
+	}
+	return true;
+}
+
+void scale(const vec3_soa& a, float s, vec3_soa& out) {
+	out.resize(a.count);
+	soa_reg rs = reg_set1(s);
+	for (int i = 0; i < a.capacity; i += SOA_WIDTH) {
+		reg_store(out.x + i, reg_mul(reg_load(a.x + i), rs));
+		reg_store(out.y + i, reg_mul(reg_load(a.y + i), rs));
+		reg_store(out.z + i, reg_mul(reg_load(a.z + i), rs));
+	}
+}
+
+bool cross(const vec3_soa& a, const vec3_soa& b, vec3_soa& out) {
+	if (a.count != b.count) {
+		return false;
+	}
+	out.resize(a.count);
+	for (int i = 0; i < a.capacity; i += SOA_WIDTH) {
+		soa_reg ax = reg_load(a.x + i), ay = reg_load(a.y + i), az = reg_load(a.z + i);
+		soa_reg bx = reg_load(b.x + i), by = reg_load(b.y + i), bz = reg_load(b.z + i);
+		reg_store(out.x + i, reg_sub(reg_mul(ay, bz), reg_mul(az, by)));
+		reg_store(out.y + i, reg_sub(reg_mul(az, bx), reg_mul(ax, bz)));
+		reg_store(out.z + i, reg_sub(reg_mul(ax, by), reg_mul(ay, bx)));
+	}
+	return true;
+}
+
+// same maths as normalise(vec3): divide by the length, zero stays zero
+void normalise(const vec3_soa& a, vec3_soa& out) {
+	out.resize(a.count);
+	for (int i = 0; i < a.capacity; i += SOA_WIDTH) {
+		soa_reg ax = reg_load(a.x + i), ay = reg_load(a.y + i), az = reg_load(a.z + i);
+		soa_reg l = reg_sqrt(reg_add(reg_add(reg_mul(ax, ax), reg_mul(ay, ay)), reg_mul(az, az)));
+		reg_store(out.x + i, reg_safe_div(ax, l));
+		reg_store(out.y + i, reg_safe_div(ay, l));
+		reg_store(out.z + i, reg_safe_div(az, l));
+	}
+}
+
+bool dot(const vec3_soa& a, const vec3_soa& b, float* out) {
+	if (a.count != b.count) {
+		return false;
+	}
+	for (int i = 0; i < a.count; i += SOA_WIDTH) {
+		soa_reg d = reg_add(reg_add(
+			reg_mul(reg_load(a.x + i), reg_load(b.x + i)),
+			reg_mul(reg_load(a.y + i), reg_load(b.y + i))),
+			reg_mul(reg_load(a.z + i), reg_load(b.z + i)));
+		// out is a plain caller array, so go through an aligned scratch block and
+		// only copy the lanes that are real elements
+		alignas(SOA_ALIGN) float tmp[SOA_WIDTH];
+		reg_store(tmp, d);
+		int n = a.count - i < SOA_WIDTH ? a.count - i : SOA_WIDTH;
+		memcpy(out + i, tmp, n * sizeof(float));
+	}
+	return true;
+}
+
+void min_max(const vec3_soa& a, vec3& mn, vec3& mx) {
+	if (0 == a.count) {
+		mn = vec3(0.0f, 0.0f, 0.0f);
+		mx = vec3(0.0f, 0.0f, 0.0f);
+		return;
+	}
+	// seed with element 0 and leave the last partial register to the scalar loop,
+	// so the zero padding can never win
+	soa_reg mnx = reg_set1(a.x[0]), mny = reg_set1(a.y[0]), mnz = reg_set1(a.z[0]);
+	soa_reg mxx = mnx, mxy = mny, mxz = mnz;
+	int full = a.count / SOA_WIDTH * SOA_WIDTH;
+	for (int i = 0; i < full; i += SOA_WIDTH) {
+		soa_reg vx = reg_load(a.x + i), vy = reg_load(a.y + i), vz = reg_load(a.z + i);
+		mnx = reg_min(mnx, vx); mxx = reg_max(mxx, vx);
+		mny = reg_min(mny, vy); mxy = reg_max(mxy, vy);
+		mnz = reg_min(mnz, vz); mxz = reg_max(mxz, vz);
+	}
+	alignas(SOA_ALIGN) float lanes[6][SOA_WIDTH];
+	reg_store(lanes[0], mnx);
+	reg_store(lanes[1], mny);
+	reg_store(lanes[2], mnz);
+	reg_store(lanes[3], mxx);
+	reg_store(lanes[4], mxy);
+	reg_store(lanes[5], mxz);
+	float r[6] = { a.x[0], a.y[0], a.z[0], a.x[0], a.y[0], a.z[0] };
+	for (int l = 0; l < SOA_WIDTH; l++) {
+		for (int k = 0; k < 3; k++) {
+			if (lanes[k][l] < r[k]) r[k] = lanes[k][l];
+			if (lanes[k + 3][l] > r[k + 3]) r[k + 3] = lanes[k + 3][l];
+		}
+	}
+	for (int i = full; i < a.count; i++) {
+		float v[3] = { a.x[i], a.y[i], a.z[i] };
+		for (int k = 0; k < 3; k++) {
+			if (v[k] < r[k]) r[k] = v[k];
+			if (v[k] > r[k + 3]) r[k + 3] = v[k];
+		}
+	}
+	mn = vec3(r[0], r[1], r[2]);
+	mx = vec3(r[3], r[4], r[5]);
+}
@@ -0,0 +1,53 @@
+#ifndef _VEC3_SOA_H_
+#define _VEC3_SOA_H_
+
+#include "maths_funcs.h"
+
+// streams are padded to a multiple of this many floats (one AVX register) and
+// allocated on this byte boundary, so the bulk functions never need a tail loop
+#define SOA_PAD 8
+#define SOA_ALIGN 32
+
+/* structure-of-arrays version of a vec3 array, for bulk maths over mesh data.
+x, y and z live in separate streams:
+x0 x1 x2 x3 ... x7 | x8 ...
+y0 y1 y2 y3 ... y7 | y8 ...
+z0 z1 z2 z3 ... z7 | z8 ...
+the padding past count is kept at zero */
+struct vec3_soa {
+	vec3_soa();
+	//! create with count zeroed elements
+	explicit vec3_soa(int count);
+	//! create from an array of vec3s, eg &mesh.mVertices[0]
+	vec3_soa(const vec3* src, int count);
+	vec3_soa(const vec3_soa& rhs);
+	vec3_soa& operator= (const vec3_soa& rhs);
+	~vec3_soa();
+	//! change the element count. existing elements are kept, new ones are zero
+	void resize(int new_count);
+	vec3 get(int i) const;
+	void set(int i, const vec3& vv);
+	//! write the elements back out as vec3s
+	void to_vec3(vec3* dst) const;
+
+	int count; // elements in use
+	int capacity; // count rounded up to SOA_PAD
+	float* x;
+	float* y;
+	float* z;
+};
+
+// bulk functions. out may be the same object as an input, and is resized to
+// match the inputs. the two input versions return false and leave out alone if
+// a and b are different sizes
+bool add(const vec3_soa& a, const vec3_soa& b, vec3_soa& out);
+// a - b
+bool sub(const vec3_soa& a, const vec3_soa& b, vec3_soa& out);
+void scale(const vec3_soa& a, float s, vec3_soa& out);
+bool cross(const vec3_soa& a, const vec3_soa& b, vec3_soa& out);
+void normalise(const vec3_soa& a, vec3_soa& out);
+// out needs room for a.count floats
+bool dot(const vec3_soa& a, const vec3_soa& b, float* out);
+// per-axis min and max over all elements (both zero if a is empty)
+void min_max(const vec3_soa& a, vec3& mn, vec3& mx);
+#endif